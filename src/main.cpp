@@ -19,17 +19,62 @@ int main(int argc, char **argv)
     app.setApplicationVersion("0.0.1");
 
     QCommandLineOption startup("s", "startup command", "command");
+    QCommandLineOption simulateVrr("simulate-vrr",
+                                   "for headless testing: refresh outputs at max Hz, cap adaptive sync presentation at max Hz and log the frame rate; min is only reported, panel timing is not emulated",
+                                   "min-max");
+    QCommandLineOption virtualOutput("virtual-output",
+                                     "add a headless output, can be repeated",
+                                     "width x height[@hz]");
+    QCommandLineOption readyFd("ready-fd",
+                               "write the Wayland socket name and a newline to this fd once clients can connect",
+                               "fd");
     QCommandLineParser cl;
 
     cl.addOption(startup);
+    cl.addOption(simulateVrr);
+    cl.addOption(virtualOutput);
+    cl.addOption(readyFd);
     cl.addHelpOption();
     cl.addVersionOption();
     cl.process(app);
 
     QBoxServer server;
+    if (cl.isSet(simulateVrr)) {
+        const QStringList range = cl.value(simulateVrr).split('-');
+        bool minOk = false, maxOk = false;
+        const int minRefresh = range.value(0).toInt(&minOk);
+        const int maxRefresh = range.value(1).toInt(&maxOk);
+        if (!minOk || !maxOk || minRefresh <= 0 || maxRefresh < minRefresh)
+            qFatal("invalid refresh range \"%s\"", qPrintable(cl.value(simulateVrr)));
+        server.output->setSimulatedAdaptiveSync(minRefresh * 1000, maxRefresh * 1000);
+    }
+    int fd = -1;
+    if (cl.isSet(readyFd)) {
+        bool ok = false;
+        fd = cl.value(readyFd).toInt(&ok);
+        if (!ok || fd < 0)
+            qFatal("invalid fd \"%s\"", qPrintable(cl.value(readyFd)));
+    }
     if (!server.start())
         return -1;
 
+    /* Only once the backend runs, the outputs are announced right away. */
+    for (const QString &value : cl.values(virtualOutput)) {
+        const QStringList mode = value.split('@');
+        const QStringList size = mode.value(0).split('x');
+        bool widthOk = false, heightOk = false, refreshOk = mode.size() == 1;
+        const int width = size.value(0).toInt(&widthOk);
+        const int height = size.value(1).toInt(&heightOk);
+        const double refresh = mode.size() > 1 ? mode.value(1).toDouble(&refreshOk) : 0;
+        if (!widthOk || !heightOk || !refreshOk || size.size() != 2 || mode.size() > 2
+                || width <= 0 || height <= 0 || refresh < 0)
+            qFatal("invalid virtual output \"%s\"", qPrintable(value));
+        if (!server.output->createVirtualOutput(QSize(width, height), qRound(refresh * 1000)))
+            qFatal("failed to create virtual output \"%s\"", qPrintable(value));
+    }
+    /* Whoever waits for us expects the outputs it asked for to be there. */
+    server.notifyReady(fd);
+
     if (cl.isSet(startup)) {
         const QString command = cl.value(startup);
         QProcess::startDetached("/bin/sh", {"-c", command});
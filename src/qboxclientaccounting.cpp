@@ -0,0 +1,278 @@
+#include "qboxclientaccounting.h"
+#include "qboxserver.h"
+#include "qwconfig.h"
+
+#include <QFile>
+#include <QTimer>
+
+extern "C" {
+#include <wlr/types/wlr_compositor.h>
+}
+
+/* Frame callback rate for clients throttled for their buffer usage while
+ * no commit rate limit is configured. */
+static constexpr int ThrottledFrameRate = 10;
+
+static qint64 toNsec(const timespec *time)
+{
+    return qint64(time->tv_sec) * 1000000000 + time->tv_nsec;
+}
+
+QBoxClientAccounting::QBoxClientAccounting(QBoxServer *server):
+    m_server(server),
+    QObject(server)
+{
+    m_sc.connect(&server->compositor->handle()->events.new_surface,
+                 this, &QBoxClientAccounting::onNewSurface);
+    connect(server->xdgShell->xdgShell, &QWXdgShell::newSurface,
+            this, &QBoxClientAccounting::onNewXdgSurface);
+
+    m_tickTimer = new QTimer(this);
+    m_tickTimer->setInterval(1000);
+    connect(m_tickTimer, &QTimer::timeout, this, &QBoxClientAccounting::onTick);
+}
+
+QBoxClientAccounting::~QBoxClientAccounting()
+{
+    for (Client *client : std::as_const(m_clients)) {
+        wl_list_remove(&client->destroy.link);
+        delete client;
+    }
+}
+
+QBoxClientAccounting::Client *QBoxClientAccounting::clientFor(wl_client *handle)
+{
+    if (Client *client = m_clients.value(handle))
+        return client;
+
+    auto *client = new Client;
+    client->accounting = this;
+    client->client = handle;
+    client->id = m_nextClientId++;
+    wl_client_get_credentials(handle, &client->pid, nullptr, nullptr);
+    QFile comm(QStringLiteral("/proc/%1/comm").arg(client->pid));
+    if (comm.open(QIODevice::ReadOnly))
+        client->name = comm.readAll().trimmed();
+    client->destroy.notify = &QBoxClientAccounting::handleClientDestroy;
+    wl_client_add_destroy_listener(handle, &client->destroy);
+
+    m_clients.insert(handle, client);
+    if (!m_tickTimer->isActive())
+        m_tickTimer->start();
+    return client;
+}
+
+void QBoxClientAccounting::handleClientDestroy(wl_listener *listener, void *)
+{
+    Client *client = wl_container_of(listener, client, destroy);
+    QBoxClientAccounting *accounting = client->accounting;
+    wl_list_remove(&listener->link);
+
+    accounting->m_clients.remove(client->client);
+    if (client->throttled)
+        --accounting->m_throttledClients;
+    if (accounting->m_clients.isEmpty())
+        accounting->m_tickTimer->stop();
+    client->gone = true;
+    releaseClient(client);
+}
+
+void QBoxClientAccounting::releaseClient(Client *client)
+{
+    if (client->gone && !client->surfaces && !client->popups)
+        delete client;
+}
+
+void QBoxClientAccounting::onNewSurface(wlr_surface *surface)
+{
+    Client *client = clientFor(wl_resource_get_client(surface->resource));
+    ++client->surfaces;
+
+    auto *bufferBytes = new qint64(0);
+    m_surfaceBytes.insert(surface, bufferBytes);
+    QWSurface *s = QWSurface::from(surface);
+    connect(s, &QWSurface::commit, this, [client, surface, bufferBytes] {
+        ++client->commits;
+        ++client->commitsThisTick;
+        /* What the client keeps attached, not what its shm pool maps. */
+        const qint64 bytes = surface->buffer
+                ? qint64(surface->current.buffer_width) * surface->current.buffer_height * 4 : 0;
+        client->bufferBytes += bytes - *bufferBytes;
+        *bufferBytes = bytes;
+    });
+    connect(s, &QObject::destroyed, this, [this, client, surface, bufferBytes] {
+        m_surfaceBytes.remove(surface);
+        client->bufferBytes -= *bufferBytes;
+        delete bufferBytes;
+        --client->surfaces;
+        releaseClient(client);
+    });
+}
+
+void QBoxClientAccounting::onNewXdgSurface(wlr_xdg_surface *surface)
+{
+    Client *client = clientFor(wl_resource_get_client(surface->resource));
+    QWXdgSurface *s;
+    if (surface->role == WLR_XDG_SURFACE_ROLE_POPUP) {
+        s = QWXdgPopup::from(surface->popup);
+        ++client->popups;
+    } else {
+        s = QWXdgToplevel::from(surface->toplevel);
+    }
+
+    /* The round trip is measured from sending a configure to the client
+     * acknowledging it, older unacknowledged serials are implied. */
+    connect(s, &QWXdgSurface::configure, this, [this, surface](wlr_xdg_surface_configure *configure) {
+        QList<PendingConfigure> &pending = m_configures[surface];
+        /* A client that never acks should not grow this forever. */
+        if (pending.size() >= 64)
+            pending.removeFirst();
+        pending.append({ configure->serial, QBoxFrameScheduler::monotonicNow() });
+    });
+    connect(s, &QWXdgSurface::ackConfigure, this, [this, surface, client](wlr_xdg_surface_configure *configure) {
+        auto it = m_configures.find(surface);
+        if (it == m_configures.end())
+            return;
+        QList<PendingConfigure> &pending = it.value();
+        for (qsizetype i = 0; i < pending.size(); ++i) {
+            if (pending.at(i).serial != configure->serial)
+                continue;
+            client->lastConfigureRtt = QBoxFrameScheduler::monotonicNow() - pending.at(i).sent;
+            client->maxConfigureRtt = qMax(client->maxConfigureRtt, client->lastConfigureRtt);
+            pending.remove(0, i + 1);
+            break;
+        }
+    });
+    const bool popup = surface->role == WLR_XDG_SURFACE_ROLE_POPUP;
+    connect(s, &QObject::destroyed, this, [this, surface, client, popup] {
+        m_configures.remove(surface);
+        if (popup) {
+            --client->popups;
+            releaseClient(client);
+        }
+    });
+}
+
+void QBoxClientAccounting::onTick()
+{
+    auto config = m_server->config->current();
+    const auto &limits = config->clients;
+
+    QList<Client*> kill;
+    for (Client *client : std::as_const(m_clients)) {
+        client->commitRate = client->commitsThisTick;
+        client->commitsThisTick = 0;
+
+        const bool over = (limits.maxCommitRate && client->commitRate > limits.maxCommitRate)
+                || (limits.maxBufferBytes && client->bufferBytes > limits.maxBufferBytes);
+        if (over && limits.overLimit == QBoxConfig::OverLimit::Kill) {
+            kill.append(client);
+        } else if (over != client->throttled) {
+            qInfo("%s client %u (%s, pid %d): %d commits/s, %lld buffer bytes",
+                  over ? "throttling" : "no longer throttling", client->id,
+                  client->name.constData(), int(client->pid), client->commitRate,
+                  client->bufferBytes);
+            client->throttled = over;
+            m_throttledClients += over ? 1 : -1;
+        }
+    }
+
+    /* Destroying a client runs handleClientDestroy(), so not while
+     * iterating m_clients. */
+    for (Client *client : std::as_const(kill)) {
+        qWarning("killing client %u (%s, pid %d): %d commits/s, %lld buffer bytes",
+                 client->id, client->name.constData(), int(client->pid),
+                 client->commitRate, client->bufferBytes);
+        wl_client_destroy(client->client);
+    }
+}
+
+qint64 QBoxClientAccounting::sendFrameDone(QWSceneOutput *sceneOutput, const timespec *now)
+{
+    /* Nobody is throttled almost all of the time. */
+    if (!m_throttledClients) {
+        sceneOutput->sendFrameDone(const_cast<timespec*>(now));
+        return 0;
+    }
+
+    auto config = m_server->config->current();
+    const int rate = config->clients.maxCommitRate > 0 ? config->clients.maxCommitRate
+                                                       : ThrottledFrameRate;
+    struct Context
+    {
+        QBoxClientAccounting *accounting;
+        wlr_scene_output *sceneOutput;
+        timespec *now;
+        qint64 nowNs;
+        qint64 interval;
+        qint64 retry;
+        QList<Client*> delivered;
+    } context { this, sceneOutput->handle(), const_cast<timespec*>(now), toNsec(now),
+                1000000000 / rate, 0, {} };
+
+    /* Same as wlr_scene_output_send_frame_done(), minus the held back
+     * callbacks. */
+    wlr_scene_output_for_each_buffer(sceneOutput->handle(), [](wlr_scene_buffer *buffer, int, int, void *data) {
+        auto *context = static_cast<Context*>(data);
+        if (buffer->primary_output != context->sceneOutput)
+            return;
+#if WLR_VERSION_MINOR > 16
+        wlr_scene_surface *sceneSurface = wlr_scene_surface_try_from_buffer(buffer);
+#else
+        wlr_scene_surface *sceneSurface = wlr_scene_surface_from_buffer(buffer);
+#endif
+        Client *client = sceneSurface
+                ? context->accounting->m_clients.value(wl_resource_get_client(sceneSurface->surface->resource))
+                : nullptr;
+        if (client && client->throttled) {
+            const qint64 due = client->lastFrameDone + context->interval;
+            if (context->nowNs < due) {
+                const qint64 retry = due - context->nowNs;
+                if (!context->retry || retry < context->retry)
+                    context->retry = retry;
+                return;
+            }
+            if (!context->delivered.contains(client))
+                context->delivered.append(client);
+        }
+        wlr_scene_buffer_send_frame_done(buffer, context->now);
+    }, &context);
+
+    for (Client *client : std::as_const(context.delivered))
+        client->lastFrameDone = context.nowNs;
+    return context.retry;
+}
+
+void QBoxClientAccounting::appendMemoryStatistics(QByteArray *out) const
+{
+    qint64 total = 0;
+    for (auto it = m_surfaceBytes.cbegin(); it != m_surfaceBytes.cend(); ++it) {
+        if (!*it.value())
+            continue;
+        total += *it.value();
+        wl_resource *resource = it.key()->resource;
+        const Client *client = m_clients.value(wl_resource_get_client(resource));
+        /* Surfaces are named by their object id within the client. */
+        *out += "memory.client." + QByteArray::number(client ? client->id : 0)
+                + ".surface." + QByteArray::number(wl_resource_get_id(resource))
+                + ".buffer_bytes=" + QByteArray::number(*it.value()) + '\n';
+    }
+    *out += "memory.clients.buffer_bytes=" + QByteArray::number(total) + '\n';
+}
+
+void QBoxClientAccounting::appendStatistics(QByteArray *out) const
+{
+    for (const Client *client : std::as_const(m_clients)) {
+        const QByteArray prefix = "client." + QByteArray::number(client->id);
+        *out += prefix + ".pid=" + QByteArray::number(client->pid) + '\n';
+        *out += prefix + ".name=" + client->name + '\n';
+        *out += prefix + ".surfaces=" + QByteArray::number(client->surfaces) + '\n';
+        *out += prefix + ".popups=" + QByteArray::number(client->popups) + '\n';
+        *out += prefix + ".commits=" + QByteArray::number(client->commits) + '\n';
+        *out += prefix + ".commit_rate=" + QByteArray::number(client->commitRate) + '\n';
+        *out += prefix + ".buffer_bytes=" + QByteArray::number(client->bufferBytes) + '\n';
+        *out += prefix + ".configure_rtt_us=" + QByteArray::number(client->lastConfigureRtt / 1000) + '\n';
+        *out += prefix + ".configure_rtt_max_us=" + QByteArray::number(client->maxConfigureRtt / 1000) + '\n';
+        *out += prefix + ".throttled=" + QByteArray::number(client->throttled) + '\n';
+    }
+}
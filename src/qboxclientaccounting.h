@@ -0,0 +1,97 @@
+#ifndef QBOXCLIENTACCOUNTING_H
+#define QBOXCLIENTACCOUNTING_H
+
+#include <qwsignalconnector.h>
+#include <qwscene.h>
+#include <QObject>
+#include <QHash>
+
+extern "C" {
+#include <wayland-server-core.h>
+}
+
+QT_BEGIN_NAMESPACE
+class QTimer;
+QT_END_NAMESPACE
+
+struct wlr_surface;
+struct wlr_xdg_surface;
+struct wlr_xdg_surface_configure;
+
+using QW_NAMESPACE::QWSignalConnector;
+using QW_NAMESPACE::QWSceneOutput;
+
+class QBoxServer;
+
+/* Keeps per client counters of what it costs the compositor and enforces
+ * the [clients] limits on them. Everything is sampled on a one second
+ * tick, the per commit work is a couple of increments. */
+class QBoxClientAccounting : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QBoxClientAccounting(QBoxServer *server);
+    ~QBoxClientAccounting();
+
+    /* Replaces wlr_scene_output_send_frame_done(). Frame callbacks of
+     * throttled clients are held back to their allowed rate; returns after
+     * how many ns the output should be rendered again to deliver them, 0
+     * if nothing was held back. */
+    qint64 sendFrameDone(QWSceneOutput *sceneOutput, const timespec *now);
+    void appendStatistics(QByteArray *out) const;
+    /* The buffer of every surface that has one attached. */
+    void appendMemoryStatistics(QByteArray *out) const;
+
+private:
+    struct Client
+    {
+        wl_listener destroy;
+        QBoxClientAccounting *accounting;
+        wl_client *client;
+        uint32_t id;
+        pid_t pid = 0;
+        QByteArray name;
+
+        int surfaces = 0;
+        int popups = 0;
+        quint64 commits = 0;
+        int commitsThisTick = 0;
+        int commitRate = 0;
+        qint64 bufferBytes = 0;
+
+        qint64 lastConfigureRtt = 0; // ns
+        qint64 maxConfigureRtt = 0;
+
+        bool throttled = false;
+        qint64 lastFrameDone = 0;
+        /* libwayland tells us about the client going away before its
+         * surfaces, so the counters outlive it until those are gone too. */
+        bool gone = false;
+    };
+
+    struct PendingConfigure
+    {
+        uint32_t serial;
+        qint64 sent;
+    };
+
+    Client *clientFor(wl_client *client);
+    static void handleClientDestroy(wl_listener *listener, void *data);
+    static void releaseClient(Client *client);
+    void onNewSurface(wlr_surface *surface);
+    void onNewXdgSurface(wlr_xdg_surface *surface);
+    void onTick();
+
+    QHash<wl_client*, Client*> m_clients;
+    /* Only read for memory dumps, commits update the pointee. */
+    QHash<wlr_surface*, qint64*> m_surfaceBytes;
+    QHash<wlr_xdg_surface*, QList<PendingConfigure>> m_configures;
+    QTimer *m_tickTimer;
+    int m_throttledClients = 0;
+    uint32_t m_nextClientId = 1;
+    QWSignalConnector m_sc;
+
+    QBoxServer *m_server;
+};
+
+#endif // QBOXCLIENTACCOUNTING_H
@@ -0,0 +1,368 @@
+#include "qboxclipboard.h"
+#include "qboxserver.h"
+
+#include <QSocketNotifier>
+#include <QTimer>
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <unistd.h>
+
+extern "C" {
+#include <wlr/types/wlr_primary_selection.h>
+}
+
+/* A source client that keeps the pipe open this long is given up on, the
+ * selection then stays served by the client itself. */
+static constexpr int CaptureTimeout = 5000; // ms
+/* A pasting client that stops reading for this long is given up on, it
+ * would otherwise hold the memfd forever. */
+static constexpr int TransferTimeout = 5000; // ms
+
+struct QBoxClipboard::DataSource
+{
+    wlr_data_source base;
+    QBoxClipboard *clipboard;
+    QSharedPointer<Cache> cache;
+};
+
+struct QBoxClipboard::PrimarySource
+{
+    wlr_primary_selection_source base;
+    QBoxClipboard *clipboard;
+    QSharedPointer<Cache> cache;
+};
+
+QBoxClipboard::Cache::~Cache()
+{
+    for (const Offer &offer : std::as_const(offers)) {
+        if (offer.fd >= 0)
+            close(offer.fd);
+    }
+}
+
+QBoxClipboard::QBoxClipboard(QBoxServer *server, QWSeat *seat):
+    m_seat(seat),
+    m_server(server),
+    QObject(server)
+{
+}
+
+QBoxClipboard::~QBoxClipboard()
+{
+    for (int selection = 0; selection < SelectionCount; ++selection)
+        abortCapture(Selection(selection));
+    while (!m_transfers.isEmpty())
+        destroyTransfer(m_transfers.first());
+}
+
+void QBoxClipboard::selectionChanged(wlr_data_source *source)
+{
+    abortCapture(Clipboard);
+    auto config = m_server->config->current();
+    if (!config->clipboard.cache || !source || m_seat->handle()->selection_source != source)
+        return;
+    startCapture(Clipboard, source, &source->mime_types, &source->events.destroy);
+}
+
+void QBoxClipboard::primarySelectionChanged(wlr_primary_selection_source *source)
+{
+    abortCapture(Primary);
+    /* The primary selection changes with every drag over some text, only
+     * copy it when asked to. */
+    auto config = m_server->config->current();
+    if (!config->clipboard.cache || !config->clipboard.primary || !source
+            || m_seat->handle()->primary_selection_source != source)
+        return;
+    startCapture(Primary, source, &source->mime_types, &source->events.destroy);
+}
+
+void QBoxClipboard::startCapture(Selection selection, void *source, wl_array *mimeTypes, wl_signal *destroy)
+{
+    auto *capture = new Capture;
+    capture->clipboard = this;
+    capture->selection = selection;
+    capture->source = source;
+    capture->cache = QSharedPointer<Cache>::create();
+    capture->sourceDestroy.notify = &QBoxClipboard::handleSourceDestroy;
+    wl_signal_add(destroy, &capture->sourceDestroy);
+    capture->timeout = new QTimer(this);
+    capture->timeout->setSingleShot(true);
+    connect(capture->timeout, &QTimer::timeout, this, [this, selection] {
+        qWarning("selection source did not finish sending within %d ms, not caching it", CaptureTimeout);
+        abortCapture(selection);
+    });
+    m_captures[selection] = capture;
+
+    char **mimeType;
+    wl_array_for_each(mimeType, mimeTypes) {
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC | O_NONBLOCK) < 0) {
+            qWarning("failed to create a pipe for the selection: %s", strerror(errno));
+            abortCapture(selection);
+            return;
+        }
+        Offer offer;
+        offer.mimeType = *mimeType;
+        offer.fd = memfd_create("qwlbox-selection", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (offer.fd < 0) {
+            qWarning("failed to create a memfd for the selection: %s", strerror(errno));
+            close(fds[0]);
+            close(fds[1]);
+            abortCapture(selection);
+            return;
+        }
+        capture->cache->offers.append(offer);
+
+        /* The source takes ownership of the write end. */
+        if (selection == Clipboard)
+            wlr_data_source_send(static_cast<wlr_data_source*>(source), *mimeType, fds[1]);
+        else
+            wlr_primary_selection_source_send(static_cast<wlr_primary_selection_source*>(source), *mimeType, fds[1]);
+
+        const qsizetype index = capture->reads.size();
+        Read read { fds[0], new QSocketNotifier(fds[0], QSocketNotifier::Read, this),
+                    capture->cache->offers.size() - 1 };
+        connect(read.notifier, &QSocketNotifier::activated, this, [this, capture, index] {
+            onCaptureReadable(capture, index);
+        });
+        capture->reads.append(read);
+        ++capture->pending;
+    }
+
+    if (!capture->pending) {
+        abortCapture(selection);
+        return;
+    }
+    capture->timeout->start(CaptureTimeout);
+}
+
+void QBoxClipboard::onCaptureReadable(Capture *capture, qsizetype index)
+{
+    Read &read = capture->reads[index];
+    Offer &offer = capture->cache->offers[read.offer];
+    auto config = m_server->config->current();
+
+    for (;;) {
+        /* Straight from the pipe into the page cache of the memfd. */
+        loff_t offset = offer.size;
+        ssize_t n = splice(read.fd, nullptr, offer.fd, &offset, 1 << 20,
+                           SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+        if (n > 0) {
+            offer.size += n;
+            capture->size += n;
+            if (capture->size > config->clipboard.maxBytes) {
+                qInfo("selection is larger than %lld bytes, not caching it",
+                      config->clipboard.maxBytes);
+                abortCapture(capture->selection);
+                return;
+            }
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if (n < 0) {
+            qWarning("failed to read the selection: %s", strerror(errno));
+            abortCapture(capture->selection);
+            return;
+        }
+        break;
+    }
+
+    /* End of file, this MIME type is complete. */
+    read.notifier->setEnabled(false);
+    read.notifier->deleteLater();
+    read.notifier = nullptr;
+    close(read.fd);
+    read.fd = -1;
+    fcntl(offer.fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+    if (--capture->pending == 0)
+        finishCapture(capture->selection);
+}
+
+void QBoxClipboard::finishCapture(Selection selection)
+{
+    Capture *capture = m_captures[selection];
+    wlr_seat *seat = m_seat->handle();
+    void *current = selection == Clipboard ? static_cast<void*>(seat->selection_source)
+                                           : static_cast<void*>(seat->primary_selection_source);
+    /* Take over if the selection is still the captured one, or if its
+     * client has gone away and nothing replaced it. */
+    const bool install = current == capture->source;
+    QSharedPointer<Cache> cache = capture->cache;
+    abortCapture(selection);
+    if (!install)
+        return;
+
+    static const wlr_data_source_impl dataSourceImpl = {
+        .send = &QBoxClipboard::dataSourceSend,
+        .destroy = &QBoxClipboard::dataSourceDestroy,
+    };
+    static const wlr_primary_selection_source_impl primarySourceImpl = {
+        .send = &QBoxClipboard::primarySourceSend,
+        .destroy = &QBoxClipboard::primarySourceDestroy,
+    };
+
+    const uint32_t serial = wl_display_next_serial(m_server->display->handle());
+    if (selection == Clipboard) {
+        auto *source = new DataSource;
+        wlr_data_source_init(&source->base, &dataSourceImpl);
+        for (const Offer &offer : std::as_const(cache->offers)) {
+            char **mimeType = static_cast<char**>(wl_array_add(&source->base.mime_types, sizeof(char*)));
+            *mimeType = strdup(offer.mimeType.constData());
+        }
+        source->clipboard = this;
+        source->cache = cache;
+        wlr_seat_set_selection(seat, &source->base, serial);
+    } else {
+        auto *source = new PrimarySource;
+        wlr_primary_selection_source_init(&source->base, &primarySourceImpl);
+        for (const Offer &offer : std::as_const(cache->offers)) {
+            char **mimeType = static_cast<char**>(wl_array_add(&source->base.mime_types, sizeof(char*)));
+            *mimeType = strdup(offer.mimeType.constData());
+        }
+        source->clipboard = this;
+        source->cache = cache;
+        wlr_seat_set_primary_selection(seat, &source->base, serial);
+    }
+}
+
+void QBoxClipboard::abortCapture(Selection selection)
+{
+    Capture *capture = m_captures[selection];
+    if (!capture)
+        return;
+    m_captures[selection] = nullptr;
+
+    for (const Read &read : std::as_const(capture->reads)) {
+        if (read.fd < 0)
+            continue;
+        /* We may be inside its activated() signal. */
+        read.notifier->setEnabled(false);
+        read.notifier->deleteLater();
+        close(read.fd);
+    }
+    capture->timeout->deleteLater();
+    if (capture->source)
+        wl_list_remove(&capture->sourceDestroy.link);
+    delete capture;
+}
+
+void QBoxClipboard::handleSourceDestroy(wl_listener *listener, void *)
+{
+    /* Usually the client exiting right after the copy. What it already
+     * wrote is still in the pipes, keep reading. */
+    Capture *capture = wl_container_of(listener, capture, sourceDestroy);
+    wl_list_remove(&listener->link);
+    capture->source = nullptr;
+}
+
+void QBoxClipboard::dataSourceSend(wlr_data_source *source, const char *mimeType, int fd)
+{
+    auto *self = reinterpret_cast<DataSource*>(source);
+    self->clipboard->serve(self->cache, mimeType, fd);
+}
+
+void QBoxClipboard::dataSourceDestroy(wlr_data_source *source)
+{
+    delete reinterpret_cast<DataSource*>(source);
+}
+
+void QBoxClipboard::primarySourceSend(wlr_primary_selection_source *source, const char *mimeType, int fd)
+{
+    auto *self = reinterpret_cast<PrimarySource*>(source);
+    self->clipboard->serve(self->cache, mimeType, fd);
+}
+
+void QBoxClipboard::primarySourceDestroy(wlr_primary_selection_source *source)
+{
+    delete reinterpret_cast<PrimarySource*>(source);
+}
+
+void QBoxClipboard::serve(const QSharedPointer<Cache> &cache, const char *mimeType, int fd)
+{
+    const Offer *offer = nullptr;
+    for (const Offer &o : std::as_const(cache->offers)) {
+        if (o.mimeType == mimeType) {
+            offer = &o;
+            break;
+        }
+    }
+    if (!offer) {
+        close(fd);
+        return;
+    }
+
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    auto *transfer = new Transfer { fd, offer->fd, 0, offer->size, cache,
+                                    new QSocketNotifier(fd, QSocketNotifier::Write, this),
+                                    new QTimer(this) };
+    transfer->notifier->setEnabled(false);
+    connect(transfer->notifier, &QSocketNotifier::activated, this, [this, transfer] {
+        onTransferWritable(transfer);
+    });
+    transfer->timeout->setSingleShot(true);
+    connect(transfer->timeout, &QTimer::timeout, this, [this, transfer] {
+        qWarning("pasting client did not read the selection within %d ms, giving up", TransferTimeout);
+        destroyTransfer(transfer);
+    });
+    m_transfers.append(transfer);
+    onTransferWritable(transfer);
+}
+
+void QBoxClipboard::onTransferWritable(Transfer *transfer)
+{
+    /* A reader that went away must not take the compositor down with
+     * SIGPIPE, and ignoring it process wide would leak into spawned
+     * programs. Block it around the writes and eat a pending one. */
+    sigset_t pipeSet, oldSet;
+    sigemptyset(&pipeSet);
+    sigaddset(&pipeSet, SIGPIPE);
+    pthread_sigmask(SIG_BLOCK, &pipeSet, &oldSet);
+
+    bool done = false;
+    while (transfer->offset < transfer->size) {
+        ssize_t n = sendfile(transfer->fd, transfer->memfd, &transfer->offset,
+                             transfer->size - transfer->offset);
+        if (n > 0)
+            continue;
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        if (n < 0 && errno == EPIPE) {
+            const timespec zero {};
+            sigtimedwait(&pipeSet, nullptr, &zero);
+        }
+        done = true;
+        break;
+    }
+    pthread_sigmask(SIG_SETMASK, &oldSet, nullptr);
+
+    if (done || transfer->offset >= transfer->size) {
+        destroyTransfer(transfer);
+    } else {
+        /* Counted from the last time the reader made room. */
+        transfer->timeout->start(TransferTimeout);
+        transfer->notifier->setEnabled(true);
+    }
+}
+
+void QBoxClipboard::destroyTransfer(Transfer *transfer)
+{
+    m_transfers.removeOne(transfer);
+    transfer->notifier->setEnabled(false);
+    transfer->notifier->deleteLater();
+    /* We may be inside its timeout() signal. */
+    transfer->timeout->stop();
+    transfer->timeout->deleteLater();
+    close(transfer->fd);
+    delete transfer;
+}
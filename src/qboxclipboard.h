@@ -0,0 +1,118 @@
+#ifndef QBOXCLIPBOARD_H
+#define QBOXCLIPBOARD_H
+
+#include <qwseat.h>
+#include <QObject>
+#include <QList>
+#include <QSharedPointer>
+
+extern "C" {
+#include <wayland-server-core.h>
+}
+
+QT_BEGIN_NAMESPACE
+class QSocketNotifier;
+class QTimer;
+QT_END_NAMESPACE
+
+struct wlr_data_source;
+struct wlr_primary_selection_source;
+
+using QW_NAMESPACE::QWSeat;
+
+class QBoxServer;
+
+/* Optional compositor owned copy of the selections ([clipboard] cache).
+ *
+ * Once a client sets a selection, every offered MIME type is spliced from
+ * the source client into a memfd. When all of them arrived the selection
+ * is replaced by one served from those memfds with sendfile(), so pastes
+ * neither wait for the source client nor disappear with it. */
+class QBoxClipboard : public QObject
+{
+    Q_OBJECT
+public:
+    QBoxClipboard(QBoxServer *server, QWSeat *seat);
+    ~QBoxClipboard();
+
+    /* The seat just took over a selection set by a client. */
+    void selectionChanged(wlr_data_source *source);
+    void primarySelectionChanged(wlr_primary_selection_source *source);
+
+private:
+    enum Selection {
+        Clipboard,
+        Primary,
+        SelectionCount,
+    };
+
+    struct Offer
+    {
+        QByteArray mimeType;
+        int fd = -1;
+        qint64 size = 0;
+    };
+    /* Shared by the source serving it and by running transfers, which may
+     * outlive the source. */
+    struct Cache
+    {
+        ~Cache();
+        QList<Offer> offers;
+    };
+
+    struct Read
+    {
+        int fd;
+        QSocketNotifier *notifier;
+        qsizetype offer;
+    };
+    struct Capture
+    {
+        wl_listener sourceDestroy;
+        QBoxClipboard *clipboard;
+        Selection selection;
+        void *source;
+        QSharedPointer<Cache> cache;
+        QList<Read> reads;
+        int pending = 0;
+        qint64 size = 0;
+        QTimer *timeout;
+    };
+
+    struct DataSource;
+    struct PrimarySource;
+
+    struct Transfer
+    {
+        int fd;
+        int memfd;
+        off_t offset;
+        qint64 size;
+        QSharedPointer<Cache> cache;
+        QSocketNotifier *notifier;
+        QTimer *timeout;
+    };
+
+    void startCapture(Selection selection, void *source, wl_array *mimeTypes, wl_signal *destroy);
+    void abortCapture(Selection selection);
+    void onCaptureReadable(Capture *capture, qsizetype read);
+    void finishCapture(Selection selection);
+    static void handleSourceDestroy(wl_listener *listener, void *data);
+
+    void serve(const QSharedPointer<Cache> &cache, const char *mimeType, int fd);
+    void onTransferWritable(Transfer *transfer);
+    void destroyTransfer(Transfer *transfer);
+
+    static void dataSourceSend(wlr_data_source *source, const char *mimeType, int fd);
+    static void dataSourceDestroy(wlr_data_source *source);
+    static void primarySourceSend(wlr_primary_selection_source *source, const char *mimeType, int fd);
+    static void primarySourceDestroy(wlr_primary_selection_source *source);
+
+    Capture *m_captures[SelectionCount] = {};
+    QList<Transfer*> m_transfers;
+    QWSeat *m_seat;
+
+    QBoxServer *m_server;
+};
+
+#endif // QBOXCLIPBOARD_H
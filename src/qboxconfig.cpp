@@ -0,0 +1,303 @@
+#include "qboxconfig.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <QSet>
+#include <QStandardPaths>
+#include <QTimer>
+
+QBoxConfig::QBoxConfig(QObject *parent):
+    QObject(parent),
+    m_watcher(new QFileSystemWatcher(this)),
+    m_reloadTimer(new QTimer(this))
+{
+    /* Editors usually write a new file and rename it over the old one, so
+     * watch the directory too and coalesce the burst of notifications. */
+    m_reloadTimer->setSingleShot(true);
+    m_reloadTimer->setInterval(50);
+    connect(m_reloadTimer, &QTimer::timeout, this, &QBoxConfig::reload);
+    connect(m_watcher, &QFileSystemWatcher::fileChanged, m_reloadTimer, qOverload<>(&QTimer::start));
+    connect(m_watcher, &QFileSystemWatcher::directoryChanged, m_reloadTimer, qOverload<>(&QTimer::start));
+
+    auto snapshot = QSharedPointer<Snapshot>::create();
+    QFile file(configPath());
+    if (file.open(QIODevice::ReadOnly))
+        m_configData = file.readAll();
+    if (!parse(m_configData, file.fileName(), snapshot.get())) {
+        *snapshot = Snapshot();
+        parse(QByteArray(), QString(), snapshot.get());
+    }
+    m_current = snapshot;
+
+    QFile keybindings(keybindingsPath());
+    if (keybindings.open(QIODevice::ReadOnly))
+        m_keybindingsData = keybindings.readAll();
+
+    updateWatches();
+}
+
+QString QBoxConfig::configDir() const
+{
+    return QStandardPaths::writableLocation(QStandardPaths::GenericConfigLocation)
+            + QStringLiteral("/qwlbox");
+}
+
+QString QBoxConfig::configPath() const
+{
+    return configDir() + QStringLiteral("/qwlbox.conf");
+}
+
+QString QBoxConfig::keybindingsPath() const
+{
+    return configDir() + QStringLiteral("/keybindings");
+}
+
+void QBoxConfig::updateWatches()
+{
+    /* Until the qwlbox directory exists, watch its parent for it to appear. */
+    const QString dir = configDir();
+    const QStringList candidates {
+        QFileInfo(dir).absolutePath(),
+        dir,
+        configPath(),
+        keybindingsPath(),
+    };
+    for (const QString &path : candidates) {
+        if (QFile::exists(path) && !m_watcher->files().contains(path)
+                && !m_watcher->directories().contains(path)) {
+            m_watcher->addPath(path);
+        }
+    }
+}
+
+void QBoxConfig::reload()
+{
+    updateWatches();
+
+    QFile keybindings(keybindingsPath());
+    QByteArray keybindingsData = keybindings.open(QIODevice::ReadOnly) ? keybindings.readAll() : QByteArray();
+    if (keybindingsData != m_keybindingsData) {
+        m_keybindingsData = keybindingsData;
+        Q_EMIT keybindingsChanged();
+    }
+
+    QFile file(configPath());
+    QByteArray data = file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+    if (data == m_configData)
+        return;
+    m_configData = data;
+
+    auto next = QSharedPointer<Snapshot>::create();
+    if (!parse(data, file.fileName(), next.get())) {
+        qWarning("configuration not reloaded, keeping the current one");
+        return;
+    }
+
+    /* Swap first so every handler sees the new snapshot, then only notify
+     * the parts that actually differ. */
+    QSharedPointer<const Snapshot> previous = m_current;
+    m_current = next;
+
+    if (!(previous->general == next->general))
+        Q_EMIT generalChanged();
+    if (!previous->keyboard.sameKeymap(next->keyboard))
+        Q_EMIT keymapChanged();
+    if (previous->keyboard.repeatRate != next->keyboard.repeatRate
+            || previous->keyboard.repeatDelay != next->keyboard.repeatDelay)
+        Q_EMIT repeatInfoChanged();
+    if (!(previous->cursor == next->cursor))
+        Q_EMIT cursorChanged();
+
+    QSet<QString> names;
+    for (auto it = previous->outputs.cbegin(); it != previous->outputs.cend(); ++it)
+        names.insert(it.key());
+    for (auto it = next->outputs.cbegin(); it != next->outputs.cend(); ++it)
+        names.insert(it.key());
+    for (const QString &name : std::as_const(names)) {
+        if (!(previous->outputs.value(name) == next->outputs.value(name)))
+            Q_EMIT outputChanged(name);
+    }
+}
+
+bool QBoxConfig::parse(const QByteArray &data, const QString &origin, Snapshot *snapshot)
+{
+    bool sizeIsOk = false;
+    snapshot->cursor.theme = qEnvironmentVariable("XCURSOR_THEME");
+    snapshot->cursor.size = qEnvironmentVariableIntValue("XCURSOR_SIZE", &sizeIsOk);
+    if (!sizeIsOk)
+        snapshot->cursor.size = 24;
+
+    QString section;
+    const QList<QByteArray> lines = data.split('\n');
+    for (int i = 0; i < lines.size(); ++i) {
+        const QString line = QString::fromUtf8(lines.at(i)).trimmed();
+        if (line.isEmpty() || line.startsWith(QLatin1Char('#')))
+            continue;
+
+        if (line.startsWith(QLatin1Char('[')) && line.endsWith(QLatin1Char(']'))) {
+            section = line.mid(1, line.size() - 2).trimmed();
+            continue;
+        }
+
+        const qsizetype equal = line.indexOf(QLatin1Char('='));
+        if (equal < 0) {
+            qWarning("%s:%d: expected \"key = value\"", qPrintable(origin), i + 1);
+            return false;
+        }
+        const QString key = line.left(equal).trimmed();
+        const QString value = line.mid(equal + 1).trimmed();
+
+        auto toInt = [&](int *result) {
+            bool ok = false;
+            *result = value.toInt(&ok);
+            return ok;
+        };
+        auto toBool = [&](bool *result) {
+            *result = value == QLatin1String("on");
+            return *result || value == QLatin1String("off");
+        };
+
+        bool ok = false;
+        if (section == QLatin1String("general")) {
+            if (key == QLatin1String("titlebar_height")) {
+                ok = toInt(&snapshot->general.titlebarHeight);
+            } else if (key == QLatin1String("placement")) {
+                static const QHash<QString, Placement> placements {
+                    { QStringLiteral("origin"), Placement::Origin },
+                    { QStringLiteral("center"), Placement::Center },
+                    { QStringLiteral("cursor"), Placement::Cursor },
+                };
+                ok = placements.contains(value);
+                snapshot->general.placement = placements.value(value);
+            } else if (key == QLatin1String("decorations")) {
+                static const QHash<QString, Decorations> decorations {
+                    { QStringLiteral("server"), Decorations::Server },
+                    { QStringLiteral("client"), Decorations::Client },
+                };
+                ok = decorations.contains(value);
+                snapshot->general.decorations = decorations.value(value);
+            } else if (key == QLatin1String("resize_snapshot")) {
+                ok = toBool(&snapshot->general.resizeSnapshot);
+            } else if (key == QLatin1String("idle_timeout")) {
+                ok = toInt(&snapshot->general.idleTimeout) && snapshot->general.idleTimeout >= 0;
+            }
+        } else if (section == QLatin1String("keyboard")) {
+            ok = true;
+            if (key == QLatin1String("rules"))
+                snapshot->keyboard.rules = value;
+            else if (key == QLatin1String("model"))
+                snapshot->keyboard.model = value;
+            else if (key == QLatin1String("layout"))
+                snapshot->keyboard.layout = value;
+            else if (key == QLatin1String("variant"))
+                snapshot->keyboard.variant = value;
+            else if (key == QLatin1String("options"))
+                snapshot->keyboard.options = value;
+            else if (key == QLatin1String("repeat_rate"))
+                ok = toInt(&snapshot->keyboard.repeatRate);
+            else if (key == QLatin1String("repeat_delay"))
+                ok = toInt(&snapshot->keyboard.repeatDelay);
+            else
+                ok = false;
+        } else if (section == QLatin1String("cursor")) {
+            if (key == QLatin1String("theme")) {
+                snapshot->cursor.theme = value;
+                ok = true;
+            } else if (key == QLatin1String("size")) {
+                ok = toInt(&snapshot->cursor.size) && snapshot->cursor.size > 0;
+            }
+        } else if (section == QLatin1String("clipboard")) {
+            if (key == QLatin1String("cache")) {
+                ok = toBool(&snapshot->clipboard.cache);
+            } else if (key == QLatin1String("primary")) {
+                ok = toBool(&snapshot->clipboard.primary);
+            } else if (key == QLatin1String("max_size")) {
+                /* In MiB, for all MIME types of one selection together */
+                int size = 0;
+                ok = toInt(&size) && size > 0;
+                snapshot->clipboard.maxBytes = qint64(size) * 1024 * 1024;
+            }
+        } else if (section == QLatin1String("clients")) {
+            if (key == QLatin1String("max_commit_rate")) {
+                ok = toInt(&snapshot->clients.maxCommitRate) && snapshot->clients.maxCommitRate >= 0;
+            } else if (key == QLatin1String("max_buffer_size")) {
+                /* In MiB */
+                int size = 0;
+                ok = toInt(&size) && size >= 0;
+                snapshot->clients.maxBufferBytes = qint64(size) * 1024 * 1024;
+            } else if (key == QLatin1String("over_limit")) {
+                static const QHash<QString, OverLimit> actions {
+                    { QStringLiteral("throttle"), OverLimit::Throttle },
+                    { QStringLiteral("kill"), OverLimit::Kill },
+                };
+                ok = actions.contains(value);
+                snapshot->clients.overLimit = actions.value(value);
+            }
+        } else if (section == QLatin1String("xwayland")) {
+            if (key == QLatin1String("enabled")) {
+                ok = toBool(&snapshot->xwayland.enabled);
+            } else if (key == QLatin1String("terminate_delay")) {
+                ok = toInt(&snapshot->xwayland.terminateDelay) && snapshot->xwayland.terminateDelay >= 0;
+            }
+        } else if (section == QLatin1String("touch")) {
+            if (key == QLatin1String("pointer_emulation")) {
+                ok = toBool(&snapshot->touch.pointerEmulation);
+            }
+        } else if (section.startsWith(QLatin1String("output:"))) {
+            Output &output = snapshot->outputs[section.mid(7)];
+            if (key == QLatin1String("enabled")) {
+                ok = toBool(&output.enabled);
+            } else if (key == QLatin1String("mode")) {
+                /* WIDTHxHEIGHT[@HZ] */
+                const QString size = value.section(QLatin1Char('@'), 0, 0);
+                const QString refresh = value.section(QLatin1Char('@'), 1);
+                bool w = false, h = false, r = true;
+                output.mode = QSize(size.section(QLatin1Char('x'), 0, 0).toInt(&w),
+                                    size.section(QLatin1Char('x'), 1).toInt(&h));
+                if (!refresh.isEmpty())
+                    output.refresh = qRound(refresh.toDouble(&r) * 1000);
+                ok = w && h && r && !output.mode.isEmpty();
+            } else if (key == QLatin1String("position")) {
+                bool x = false, y = false;
+                output.position = QPoint(value.section(QLatin1Char(','), 0, 0).toInt(&x),
+                                         value.section(QLatin1Char(','), 1).toInt(&y));
+                output.hasPosition = true;
+                ok = x && y;
+            } else if (key == QLatin1String("scale")) {
+                output.scale = value.toDouble(&ok);
+                ok = ok && output.scale > 0;
+            } else if (key == QLatin1String("transform")) {
+                static const QHash<QString, wl_output_transform> transforms {
+                    { QStringLiteral("normal"), WL_OUTPUT_TRANSFORM_NORMAL },
+                    { QStringLiteral("90"), WL_OUTPUT_TRANSFORM_90 },
+                    { QStringLiteral("180"), WL_OUTPUT_TRANSFORM_180 },
+                    { QStringLiteral("270"), WL_OUTPUT_TRANSFORM_270 },
+                    { QStringLiteral("flipped"), WL_OUTPUT_TRANSFORM_FLIPPED },
+                    { QStringLiteral("flipped-90"), WL_OUTPUT_TRANSFORM_FLIPPED_90 },
+                    { QStringLiteral("flipped-180"), WL_OUTPUT_TRANSFORM_FLIPPED_180 },
+                    { QStringLiteral("flipped-270"), WL_OUTPUT_TRANSFORM_FLIPPED_270 },
+                };
+                ok = transforms.contains(value);
+                output.transform = transforms.value(value);
+            } else if (key == QLatin1String("adaptive_sync")) {
+                static const QHash<QString, AdaptiveSync> policies {
+                    { QStringLiteral("off"), AdaptiveSync::Off },
+                    { QStringLiteral("on"), AdaptiveSync::On },
+                    { QStringLiteral("auto"), AdaptiveSync::Auto },
+                };
+                ok = policies.contains(value);
+                output.adaptiveSync = policies.value(value);
+            } else if (key == QLatin1String("tearing")) {
+                ok = toBool(&output.allowTearing);
+            }
+        }
+
+        if (!ok) {
+            qWarning("%s:%d: invalid setting \"%s\" in [%s]", qPrintable(origin), i + 1,
+                     qPrintable(line), qPrintable(section));
+            return false;
+        }
+    }
+    return true;
+}
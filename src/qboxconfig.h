@@ -0,0 +1,171 @@
+#ifndef QBOXCONFIG_H
+#define QBOXCONFIG_H
+
+#include <QObject>
+#include <QHash>
+#include <QPoint>
+#include <QSharedPointer>
+#include <QSize>
+#include <QString>
+
+extern "C" {
+#include <wayland-server-protocol.h>
+}
+
+QT_BEGIN_NAMESPACE
+class QFileSystemWatcher;
+class QTimer;
+QT_END_NAMESPACE
+
+class QBoxConfig : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QBoxConfig(QObject *parent = nullptr);
+
+    enum class Placement {
+        Origin,
+        Center,
+        Cursor,
+    };
+
+    enum class Decorations {
+        /* Drawn by the compositor unless the client asks to draw its own. */
+        Server,
+        Client,
+    };
+
+    struct General
+    {
+        int titlebarHeight = 24;
+        Placement placement = Placement::Origin;
+        Decorations decorations = Decorations::Server;
+        /* Stretch the last frame while a client catches up with a resize. */
+        bool resizeSnapshot = true;
+        int idleTimeout = 0; // seconds, 0 for never
+        bool operator==(const General &) const = default;
+    };
+
+    struct Keyboard
+    {
+        QString rules;
+        QString model;
+        QString layout;
+        QString variant;
+        QString options;
+        int repeatRate = 25;
+        int repeatDelay = 600;
+        bool sameKeymap(const Keyboard &other) const {
+            return rules == other.rules && model == other.model && layout == other.layout
+                    && variant == other.variant && options == other.options;
+        }
+    };
+
+    struct Cursor
+    {
+        QString theme;
+        int size = 24;
+        bool operator==(const Cursor &) const = default;
+    };
+
+    enum class AdaptiveSync {
+        Off,
+        On,
+        /* Only while a fullscreen or game/video client is focused on it. */
+        Auto,
+    };
+
+    struct Output
+    {
+        bool enabled = true;
+        /* An invalid mode means the preferred one. */
+        QSize mode;
+        int refresh = 0; // mHz, 0 for any
+        bool hasPosition = false;
+        QPoint position;
+        double scale = 1.0;
+        wl_output_transform transform = WL_OUTPUT_TRANSFORM_NORMAL;
+        AdaptiveSync adaptiveSync = AdaptiveSync::Off;
+        /* Let a fullscreen client asking for async presentation tear. */
+        bool allowTearing = false;
+        bool operator==(const Output &) const = default;
+    };
+
+    /* Read when a selection is set, so no change signal. */
+    struct Clipboard
+    {
+        bool cache = false;
+        bool primary = false;
+        qint64 maxBytes = 128 * 1024 * 1024;
+    };
+
+    enum class OverLimit {
+        Throttle,
+        Kill,
+    };
+
+    /* Read again on every accounting tick, so no change signal. */
+    struct Clients
+    {
+        int maxCommitRate = 0; // commits per second, 0 for no limit
+        qint64 maxBufferBytes = 0; // 0 for no limit
+        OverLimit overLimit = OverLimit::Throttle;
+    };
+
+    /* Only read at startup. */
+    struct Xwayland
+    {
+        bool enabled = true;
+        /* Seconds the server is kept after the last X11 client left. */
+        int terminateDelay = 10;
+    };
+
+    struct Touch
+    {
+        /* Touches on surfaces of clients without wl_touch, and on server-side
+         * title bars, drive the pointer instead. */
+        bool pointerEmulation = true;
+    };
+
+    /* Parsed once per reload and never modified afterwards, so it can be
+     * held on to across a reload. */
+    struct Snapshot
+    {
+        General general;
+        Keyboard keyboard;
+        Cursor cursor;
+        Clipboard clipboard;
+        Clients clients;
+        Xwayland xwayland;
+        Touch touch;
+        QHash<QString, Output> outputs;
+    };
+
+    QSharedPointer<const Snapshot> current() const {
+        return m_current;
+    }
+    QString configDir() const;
+    QString configPath() const;
+    QString keybindingsPath() const;
+
+Q_SIGNALS:
+    void generalChanged();
+    void keymapChanged();
+    void repeatInfoChanged();
+    void cursorChanged();
+    void outputChanged(const QString &name);
+    void keybindingsChanged();
+
+private:
+    void reload();
+    void updateWatches();
+    static bool parse(const QByteArray &data, const QString &origin, Snapshot *snapshot);
+
+    QSharedPointer<const Snapshot> m_current;
+    QByteArray m_configData;
+    QByteArray m_keybindingsData;
+    QFileSystemWatcher *m_watcher;
+    QTimer *m_reloadTimer;
+};
+
+#endif // QBOXCONFIG_H
@@ -1,24 +1,60 @@
 #include "qboxcursor.h"
 #include "qboxserver.h"
+#include "qwconfig.h"
 #include <qwseat.h>
 
+#include <QTimer>
+
+extern "C" {
+#include <wlr/xcursor.h>
+#include <wlr/types/wlr_xcursor_manager.h>
+#include <wlr/types/wlr_pointer_constraints_v1.h>
+#include <wlr/types/wlr_relative_pointer_v1.h>
+#include <wlr/types/wlr_touch.h>
+#include <linux/input-event-codes.h>
+#include <wlr/util/region.h>
+}
+
 QBoxCursor::QBoxCursor(QBoxServer *server):
     m_service(server),
     QObject(server)
 {
     m_cursor = new QWCursor(server);
     m_cursor->attachOutputLayout(server->output->outputLayout);
-    bool sizeIsOk = false;
-    uint32_t xcursor_size = qEnvironmentVariableIntValue("XCURSOR_SIZE", &sizeIsOk);
-    if (!sizeIsOk)
-        xcursor_size = 24;
-    m_cursorManager = QWXCursorManager::create(getenv("XCURSOR_THEME"), xcursor_size);
-    m_cursorManager->load(1);
+    auto config = server->config->current();
+    const QByteArray theme = config->cursor.theme.toUtf8();
+    /* Nothing is read from disk until the first xcursor image is set. */
+    m_cursorManager = QWXCursorManager::create(theme.isEmpty() ? nullptr : theme.constData(), config->cursor.size);
+    m_animationTimer = new QTimer(this);
+    m_animationTimer->setSingleShot(true);
+    connect(m_animationTimer, &QTimer::timeout, this, &QBoxCursor::onAnimationTimeout);
+    connect(server->config, &QBoxConfig::cursorChanged, this, &QBoxCursor::onCursorConfigChanged);
+    /* Once loaded, keep the theme loaded at every scale in use, not on
+     * the first motion over a new output. */
+    connect(server->output, &QBoxOutPut::outputAdded, this, [this] {
+        if (m_themeLoaded)
+            loadScales(m_cursorManager);
+    });
+    connect(server->config, &QBoxConfig::outputChanged, this, [this] {
+        if (m_themeLoaded)
+            loadScales(m_cursorManager);
+    });
     connect(m_cursor, &QWCursor::motion, this, &QBoxCursor::onCursorMotion);
     connect(m_cursor, &QWCursor::motionAbsolute, this, &QBoxCursor::onCursorMotionAbsolute);
     connect(m_cursor, &QWCursor::button, this, &QBoxCursor::onCursorButton);
     connect(m_cursor, &QWCursor::axis, this, &QBoxCursor::onCursorAxis);
     connect(m_cursor, &QWCursor::frame, this, &QBoxCursor::onCursorFrame);
+
+    wlr_cursor *cursor = m_cursor->handle();
+    m_sc.connect(&cursor->events.touch_down, this, &QBoxCursor::onTouchDown);
+    m_sc.connect(&cursor->events.touch_up, this, &QBoxCursor::onTouchUp);
+    m_sc.connect(&cursor->events.touch_motion, this, &QBoxCursor::onTouchMotion);
+    m_sc.connect(&cursor->events.touch_cancel, this, &QBoxCursor::onTouchCancel);
+    m_sc.connect(&cursor->events.touch_frame, this, &QBoxCursor::onTouchFrame);
+
+    m_relativePointerManager = wlr_relative_pointer_manager_v1_create(server->display->handle());
+    m_pointerConstraints = wlr_pointer_constraints_v1_create(server->display->handle());
+    m_sc.connect(&m_pointerConstraints->events.new_constraint, this, &QBoxCursor::onNewConstraint);
 }
 
 void QBoxCursor::setCursorState(CursorState state)
@@ -26,16 +62,180 @@ void QBoxCursor::setCursorState(CursorState state)
     cursorState = state;
 }
 
+void QBoxCursor::onCursorConfigChanged()
+{
+    auto config = m_service->config->current();
+    const QByteArray theme = config->cursor.theme.toUtf8();
+    auto *manager = QWXCursorManager::create(theme.isEmpty() ? nullptr : theme.constData(), config->cursor.size);
+    if (manager && !m_themeLoaded) {
+        delete m_cursorManager;
+        m_cursorManager = manager;
+        return;
+    }
+    if (!manager || !loadScales(manager)) {
+        qWarning("failed to load cursor theme \"%s\", keeping the current one", theme.constData());
+        delete manager;
+        return;
+    }
+    delete m_cursorManager;
+    m_cursorManager = manager;
+    /* Client cursor surfaces are left alone, they pick up the new theme on
+     * their next update. */
+    if (m_image.source == Image::Source::XCursor) {
+        const QByteArray name = m_image.name;
+        m_image = Image();
+        setXCursorImage(name.constData());
+    }
+}
+
+void QBoxCursor::appendMemoryStatistics(QByteArray *out) const
+{
+    int themes = 0;
+    qint64 imageBytes = 0;
+    wlr_xcursor_manager_theme *theme;
+    wl_list_for_each(theme, &m_cursorManager->handle()->scaled_themes, link) {
+        ++themes;
+        for (unsigned int i = 0; i < theme->theme->cursor_count; ++i) {
+            const wlr_xcursor *xcursor = theme->theme->cursors[i];
+            for (unsigned int j = 0; j < xcursor->image_count; ++j)
+                imageBytes += qint64(xcursor->images[j]->width) * xcursor->images[j]->height * 4;
+        }
+    }
+    *out += "memory.cursor.themes=" + QByteArray::number(themes) + '\n';
+    *out += "memory.cursor.image_bytes=" + QByteArray::number(imageBytes) + '\n';
+}
+
+bool QBoxCursor::loadScales(QWXCursorManager *manager)
+{
+    if (!manager->load(1))
+        return false;
+    for (QWOutput *output : std::as_const(m_service->output->outputs)) {
+        if (output->handle()->scale != 1)
+            manager->load(output->handle()->scale);
+    }
+    return true;
+}
+
+void QBoxCursor::setXCursorImage(const char *name)
+{
+    if (m_image.source == Image::Source::XCursor && m_image.name == name)
+        return;
+    disconnect(m_imageSurfaceConnection);
+    m_image = Image();
+    m_image.source = Image::Source::XCursor;
+    m_image.name = name;
+    if (!m_themeLoaded) {
+        m_themeLoaded = true;
+        if (!loadScales(m_cursorManager))
+            qWarning("failed to load the cursor theme");
+    }
+    m_cursor->setXCursor(m_cursorManager, name);
+
+#if WLR_VERSION_MINOR < 17
+    /* wlroots 0.16 only ever shows the first image of an xcursor. */
+    m_animationTimer->stop();
+    wlr_xcursor *xcursor = wlr_xcursor_manager_get_xcursor(m_cursorManager->handle(), name, 1);
+    if (xcursor && xcursor->image_count > 1) {
+        m_animationFrame = 0;
+        m_animationTimer->start(qMax(1u, xcursor->images[0]->delay));
+    }
+#endif
+}
+
+void QBoxCursor::setSurfaceImage(wlr_surface *surface, const QPoint &hotspot)
+{
+    /* Surface commits are tracked by wlr_cursor itself, only a new surface
+     * or hotspot needs passing on. */
+    if (m_image.source == Image::Source::Surface && m_image.surface == surface
+            && m_image.hotspot == hotspot) {
+        return;
+    }
+    m_animationTimer->stop();
+    disconnect(m_imageSurfaceConnection);
+    m_image = Image();
+    m_image.source = Image::Source::Surface;
+    m_image.surface = surface;
+    m_image.hotspot = hotspot;
+    if (surface) {
+        /* A new surface may be allocated at the same address. */
+        m_imageSurfaceConnection = connect(QWSurface::from(surface), &QObject::destroyed, this, [this] {
+            m_image = Image();
+        });
+    }
+    m_cursor->setSurface(surface ? QWSurface::from(surface) : nullptr, hotspot);
+}
+
+void QBoxCursor::onAnimationTimeout()
+{
+#if WLR_VERSION_MINOR < 17
+    if (m_image.source != Image::Source::XCursor)
+        return;
+
+    /* Same as wlr_xcursor_manager_set_cursor_image(), for the next frame. */
+    uint32_t delay = 0;
+    wlr_xcursor_manager_theme *theme;
+    wl_list_for_each(theme, &m_cursorManager->handle()->scaled_themes, link) {
+        wlr_xcursor *xcursor = wlr_xcursor_theme_get_cursor(theme->theme, m_image.name.constData());
+        if (!xcursor)
+            continue;
+        wlr_xcursor_image *image = xcursor->images[(m_animationFrame + 1) % xcursor->image_count];
+        wlr_cursor_set_image(m_cursor->handle(), image->buffer, image->width * 4,
+                             image->width, image->height, image->hotspot_x, image->hotspot_y,
+                             theme->scale);
+        if (theme->scale == 1)
+            delay = image->delay;
+    }
+    ++m_animationFrame;
+    m_animationTimer->start(qMax(1u, delay));
+#endif
+}
+
 void QBoxCursor::onCursorMotion(wlr_pointer_motion_event *event)
 {
-    m_cursor->move(QWPointer::from(event->pointer), QPointF(event->delta_x, event->delta_y));
-    processCursorMotion(event->time_msec);
+    processRelativeMotion(event->pointer, event->time_msec,
+                          QPointF(event->delta_x, event->delta_y),
+                          QPointF(event->unaccel_dx, event->unaccel_dy));
 }
 
 void QBoxCursor::onCursorMotionAbsolute(wlr_pointer_motion_absolute_event *event)
 {
-    m_cursor->warpAbsolute(QWPointer::from(event->pointer), QPointF(event->x, event->y));
-    processCursorMotion(event->time_msec);
+    /* Tablets in mouse mode and virtual machines, made relative so that
+     * constraints apply to them as well. */
+    double lx, ly;
+    wlr_cursor_absolute_to_layout_coords(m_cursor->handle(), &event->pointer->base,
+                                         event->x, event->y, &lx, &ly);
+    const QPointF delta = QPointF(lx, ly) - m_cursor->position();
+    processRelativeMotion(event->pointer, event->time_msec, delta, delta);
+}
+
+void QBoxCursor::processRelativeMotion(wlr_pointer *pointer, uint32_t time, const QPointF &delta,
+                                       const QPointF &unaccelerated)
+{
+    /* Raw deltas go to the focused client whether or not the pointer is
+     * constrained, games read these instead of the position. */
+    wlr_relative_pointer_manager_v1_send_relative_motion(m_relativePointerManager, getSeat()->handle(),
+                                                         uint64_t(time) * 1000, delta.x(), delta.y(),
+                                                         unaccelerated.x(), unaccelerated.y());
+
+    QPointF move = delta;
+    if (m_activeConstraint && cursorState == CursorState::Normal) {
+        if (m_activeConstraint->type == WLR_POINTER_CONSTRAINT_V1_LOCKED) {
+            /* Nothing moves, so there is nothing to hit-test either. */
+            m_service->idle->notifyActivity();
+            return;
+        }
+        const QPointF from = m_cursor->position() - m_focusOrigin;
+        const QPointF to = from + delta;
+        double x, y;
+        if (!wlr_region_confine(&m_activeConstraint->region, from.x(), from.y(), to.x(), to.y(), &x, &y)) {
+            m_service->idle->notifyActivity();
+            return;
+        }
+        move = QPointF(x, y) - from;
+    }
+
+    m_cursor->move(QWPointer::from(pointer), move);
+    processCursorMotion(time);
 }
 
 void QBoxCursor::onCursorButton(wlr_pointer_button_event *event)
@@ -51,12 +251,16 @@ void QBoxCursor::onCursorButton(wlr_pointer_button_event *event)
     if (event->state == WLR_BUTTON_RELEASED) {
         /* If you released any buttons, we exit interactive move/resize mode. */
         cursorState = CursorState::Normal;
+    } else if (!view && (view = m_service->decoration->titlebarAt(m_cursor->position()))) {
+        /* Dragging a server-side titlebar moves the view. */
+        xdgShell->focusView(view, view->surface());
+        xdgShell->beginInteractive(view, CursorState::MovingWindow, 0);
     } else { /// WLR_BUTTON_PRESSED
         /* Focus that client if the button was _pressed_ */
         xdgShell->focusView(view, surface);
     }
 
-    // TODO: wlr_idle_notifier_v1_notify_activity
+    m_service->idle->notifyActivity();
 }
 
 void QBoxCursor::onCursorAxis(wlr_pointer_axis_event *event)
@@ -64,6 +268,7 @@ void QBoxCursor::onCursorAxis(wlr_pointer_axis_event *event)
     /* This event is forwarded by the cursor when a pointer emits an axis event,
      * for example when you move the scroll wheel. */
 
+    m_service->idle->notifyActivity();
     /* Notify the client with pointer focus of the axis event. */
     getSeat()->pointerNotifyAxis(event->time_msec, event->orientation,
                                  event->delta, event->delta_discrete, event->source);
@@ -82,6 +287,8 @@ void QBoxCursor::onCursorFrame()
 
 void QBoxCursor::processCursorMotion(uint32_t time)
 {
+    m_service->idle->notifyActivity();
+
     /* If the mode is non-passthrough, delegate to those functions. */
     if (cursorState == CursorState::MovingWindow) {
         processCursorMove();
@@ -100,26 +307,92 @@ void QBoxCursor::processCursorMotion(uint32_t time)
      * default. This is what makes the cursor image appear when you move it
      * around the screen, not over any views. */
     if (!view)
-	m_cursor->setXCursor(m_cursorManager, "default");
+        setXCursorImage("default");
 
+    wlr_surface *focused = getSeat()->handle()->pointer_state.focused_surface;
     if (surface) {
         /*
          * "Enter" the surface if necessary. This lets the client know that the
          * cursor has entered one of its surfaces.
          *
-         * Note that wlroots will avoid sending duplicate enter/motion events if
-         * the surface has already has pointer focus or if the client is already
-         * aware of the coordinates passed.
+         * wlroots would drop a duplicate enter too, but only after looking up
+         * the wrapper and the seat client, so skip it here.
          */
-        getSeat()->pointerNotifyEnter(QWSurface::from(surface), spos.x(), spos.y());
+        m_focusOrigin = m_cursor->position() - spos;
+        if (surface != focused) {
+            getSeat()->pointerNotifyEnter(QWSurface::from(surface), spos.x(), spos.y());
+            updateConstraint(surface);
+        }
         getSeat()->pointerNotifyMotion(time, spos.x(), spos.y());
-    } else {
+    } else if (focused) {
         /* Clear pointer focus so future button events and such are not sent to
          * the last client to have the cursor over it. */
         getSeat()->pointerClearFocus();
+        updateConstraint(nullptr);
     }
+}
 
-    // TODO: wlr_idle_notifier_v1_notify_activity
+void QBoxCursor::onNewConstraint(wlr_pointer_constraint_v1 *constraint)
+{
+    auto *c = new Constraint;
+    c->cursor = this;
+    c->constraint = constraint;
+    c->destroy.notify = &QBoxCursor::handleConstraintDestroy;
+    wl_signal_add(&constraint->events.destroy, &c->destroy);
+
+    /* Usually asked for by the surface under the pointer, in response to
+     * a click. */
+    if (constraint->surface == getSeat()->handle()->pointer_state.focused_surface)
+        updateConstraint(constraint->surface);
+}
+
+void QBoxCursor::updateConstraint(wlr_surface *surface)
+{
+    wlr_pointer_constraint_v1 *constraint = nullptr;
+    if (surface)
+        constraint = wlr_pointer_constraints_v1_constraint_for_surface(m_pointerConstraints, surface,
+                                                                       getSeat()->handle());
+    setActiveConstraint(constraint);
+}
+
+void QBoxCursor::setActiveConstraint(wlr_pointer_constraint_v1 *constraint)
+{
+    if (m_activeConstraint == constraint)
+        return;
+    /* Deactivating a oneshot constraint destroys it. */
+    wlr_pointer_constraint_v1 *previous = m_activeConstraint;
+    m_activeConstraint = constraint;
+    if (previous) {
+        warpToCursorHint(previous);
+        wlr_pointer_constraint_v1_send_deactivated(previous);
+    }
+    if (constraint)
+        wlr_pointer_constraint_v1_send_activated(constraint);
+}
+
+void QBoxCursor::warpToCursorHint(wlr_pointer_constraint_v1 *constraint)
+{
+    /* A locked pointer may have been drawn elsewhere by the client, show
+     * the cursor where it left it. */
+    if (constraint->type != WLR_POINTER_CONSTRAINT_V1_LOCKED
+            || !(constraint->current.committed & WLR_POINTER_CONSTRAINT_V1_STATE_CURSOR_HINT))
+        return;
+    const QPointF hint(constraint->current.cursor_hint.x, constraint->current.cursor_hint.y);
+    const QPointF pos = m_focusOrigin + hint;
+    wlr_cursor_warp(m_cursor->handle(), nullptr, pos.x(), pos.y());
+    wlr_seat_pointer_warp(constraint->seat, hint.x(), hint.y());
+}
+
+void QBoxCursor::handleConstraintDestroy(wl_listener *listener, void *)
+{
+    Constraint *c = wl_container_of(listener, c, destroy);
+    wl_list_remove(&c->destroy.link);
+    QBoxCursor *cursor = c->cursor;
+    if (cursor->m_activeConstraint == c->constraint) {
+        cursor->m_activeConstraint = nullptr;
+        cursor->warpToCursorHint(c->constraint);
+    }
+    delete c;
 }
 
 void QBoxCursor::processCursorMove()
@@ -131,6 +404,8 @@ void QBoxCursor::processCursorMove()
     if (grabbedView->sceneTree->handle()->node.type == WLR_SCENE_NODE_TREE) {
         grabbedView->geometry.setTopLeft((grabGeoBox.topLeft() + m_cursor->position() - m_service->grabCursorPos).toPoint());
         grabbedView->sceneTree->setPosition(grabbedView->geometry.topLeft());
+        grabbedView->syncPosition();
+        Q_EMIT m_service->xdgShell->viewMoved(grabbedView);
     };
 }
 
@@ -153,17 +428,15 @@ void QBoxCursor::processCursorResize()
         newGeoBox.setRight(cursorPos.x());
     }
 
-    QSize minSize(grabbedView->xdgToplevel->handle()->current.min_width,
-                  grabbedView->xdgToplevel->handle()->current.min_height);
-    QSize maxSize(grabbedView->xdgToplevel->handle()->current.max_width,
-                  grabbedView->xdgToplevel->handle()->current.max_height);
+    QSize minSize = grabbedView->minSize();
+    QSize maxSize = grabbedView->maxSize();
 
     if (maxSize.width() == 0)
         maxSize.setWidth(99999);
     if (maxSize.height() == 0)
         maxSize.setHeight(99999);
 
-    auto currentGeoBox = grabbedView->xdgToplevel->getGeometry();
+    auto currentGeoBox = grabbedView->windowGeometry();
     currentGeoBox.moveTopLeft(grabbedView->geometry.topLeft() + currentGeoBox.topLeft());
     if (newGeoBox.width() < qMax(minimumSize, minSize.width()) || newGeoBox.width() > maxSize.width()) {
         newGeoBox.setLeft(currentGeoBox.left());
@@ -176,8 +449,152 @@ void QBoxCursor::processCursorResize()
     }
     grabbedView->geometry.setTopLeft(newGeoBox.topLeft().toPoint());
 
-    grabbedView->sceneTree->setPosition(grabbedView->geometry.topLeft());
-    grabbedView->xdgToplevel->setSize(newGeoBox.size().toSize());
+    m_service->xdgShell->resizeView(grabbedView, newGeoBox.size().toSize());
+}
+
+QPointF QBoxCursor::touchPosition(wlr_touch *touch, double x, double y) const
+{
+    double lx, ly;
+    wlr_cursor_absolute_to_layout_coords(m_cursor->handle(), &touch->base, x, y, &lx, &ly);
+    return QPointF(lx, ly);
+}
+
+void QBoxCursor::warpClosest(const QPointF &pos)
+{
+    QWOutput *output = m_service->output->outputAt(pos);
+    if (!output)
+        return;
+    const QRectF box = m_service->output->layoutBox(output);
+    /* Layout boxes are half open, stay inside the last pixel. */
+    const qreal x = qBound(box.left(), pos.x(), box.right() - 1);
+    const qreal y = qBound(box.top(), pos.y(), box.bottom() - 1);
+    wlr_cursor_warp(m_cursor->handle(), nullptr, x, y);
+}
+
+void QBoxCursor::emulatePointerButton(uint32_t time, bool pressed)
+{
+    wlr_pointer_button_event event {};
+    event.time_msec = time;
+    event.button = BTN_LEFT;
+    event.state = pressed ? WLR_BUTTON_PRESSED : WLR_BUTTON_RELEASED;
+    onCursorButton(&event);
+    onCursorFrame();
+}
+
+void QBoxCursor::onTouchDown(wlr_touch_down_event *event)
+{
+    m_service->idle->notifyActivity();
+    const QPointF pos = touchPosition(event->touch, event->x, event->y);
+    wlr_seat *seat = getSeat()->handle();
+    wlr_surface *surface = nullptr;
+    QPointF spos;
+    auto *view = m_service->xdgShell->viewAt(pos, &surface, &spos);
+#if WLR_VERSION_MINOR > 17
+    const bool acceptsTouch = surface && wlr_surface_accepts_touch(surface, seat);
+#else
+    const bool acceptsTouch = surface && wlr_surface_accepts_touch(seat, surface);
+#endif
+
+    if (!acceptsTouch) {
+        /* The first such point moves the pointer, the others are dropped. */
+        if (m_emulatedTouch < 0 && m_service->config->current()->touch.pointerEmulation) {
+            m_emulatedTouch = event->touch_id;
+            warpClosest(pos);
+            processCursorMotion(event->time_msec);
+            emulatePointerButton(event->time_msec, true);
+        }
+        return;
+    }
+
+    if (view)
+        m_service->xdgShell->focusView(view, view->surface());
+    TouchPoint point;
+    point.origin = pos - spos;
+    point.position = pos;
+    m_touchPoints.insert(event->touch_id, point);
+    wlr_seat_touch_notify_down(seat, surface, event->time_msec, event->touch_id, spos.x(), spos.y());
+}
+
+void QBoxCursor::onTouchUp(wlr_touch_up_event *event)
+{
+    if (event->touch_id == m_emulatedTouch) {
+        m_emulatedTouch = -1;
+        emulatePointerButton(event->time_msec, false);
+        return;
+    }
+    auto it = m_touchPoints.find(event->touch_id);
+    if (it == m_touchPoints.end())
+        return;
+    /* Keep the order, the last position comes before the up. */
+    if (it->motionPending) {
+        const QPointF spos = it->position - it->origin;
+        wlr_seat_touch_notify_motion(getSeat()->handle(), it->time, event->touch_id, spos.x(), spos.y());
+    }
+    m_touchPoints.erase(it);
+    wlr_seat_touch_notify_up(getSeat()->handle(), event->time_msec, event->touch_id);
+}
+
+void QBoxCursor::onTouchMotion(wlr_touch_motion_event *event)
+{
+    m_service->idle->notifyActivity();
+    const QPointF pos = touchPosition(event->touch, event->x, event->y);
+    if (event->touch_id == m_emulatedTouch) {
+        warpClosest(pos);
+        processCursorMotion(event->time_msec);
+        return;
+    }
+    auto it = m_touchPoints.find(event->touch_id);
+    if (it == m_touchPoints.end())
+        return;
+    /* No hit-testing, the point stays with its surface. */
+    it->position = pos;
+    it->time = event->time_msec;
+    it->motionPending = true;
+}
+
+void QBoxCursor::onTouchCancel(wlr_touch_cancel_event *event)
+{
+    if (event->touch_id == m_emulatedTouch) {
+        m_emulatedTouch = -1;
+        emulatePointerButton(event->time_msec, false);
+        return;
+    }
+    if (!m_touchPoints.remove(event->touch_id))
+        return;
+    wlr_seat *seat = getSeat()->handle();
+    wlr_touch_point *point = wlr_seat_touch_get_point(seat, event->touch_id);
+    if (!point)
+        return;
+    /* Cancels every point of the client, as the protocol has it. */
+#if WLR_VERSION_MINOR > 17
+    if (point->client)
+        wlr_seat_touch_notify_cancel(seat, point->client);
+#else
+    if (point->surface)
+        wlr_seat_touch_notify_cancel(seat, point->surface);
+#endif
+    for (auto it = m_touchPoints.begin(); it != m_touchPoints.end();) {
+        if (wlr_seat_touch_get_point(seat, it.key()))
+            ++it;
+        else
+            it = m_touchPoints.erase(it);
+    }
+}
+
+void QBoxCursor::onTouchFrame()
+{
+    wlr_seat *seat = getSeat()->handle();
+    for (auto it = m_touchPoints.begin(); it != m_touchPoints.end(); ++it) {
+        if (!it->motionPending)
+            continue;
+        it->motionPending = false;
+        const QPointF spos = it->position - it->origin;
+        wlr_seat_touch_notify_motion(seat, it->time, it.key(), spos.x(), spos.y());
+    }
+    /* wlroots only sends it to clients that got something since. */
+    wlr_seat_touch_notify_frame(seat);
+    if (m_emulatedTouch >= 0)
+        onCursorFrame();
 }
 
 QWSeat *QBoxCursor::getSeat()
@@ -4,8 +4,27 @@
 #include <qwcursor.h>
 #include <qwxcursormanager.h>
 #include <qwseat.h>
+#include <qwsignalconnector.h>
 
 #include <QObject>
+#include <QHash>
+
+extern "C" {
+#include <wayland-server-core.h>
+}
+
+QT_BEGIN_NAMESPACE
+class QTimer;
+QT_END_NAMESPACE
+
+struct wlr_relative_pointer_manager_v1;
+struct wlr_pointer_constraints_v1;
+struct wlr_pointer_constraint_v1;
+struct wlr_touch;
+struct wlr_touch_down_event;
+struct wlr_touch_up_event;
+struct wlr_touch_motion_event;
+struct wlr_touch_cancel_event;
 
 QW_USE_NAMESPACE
 
@@ -27,6 +46,8 @@ public:
     };
 
     void setCursorState(CursorState state);
+    /* The xcursor theme at each loaded scale. */
+    void appendMemoryStatistics(QByteArray *out) const;
     QWCursor *getCursor() {
         return m_cursor;
     };
@@ -39,16 +60,85 @@ private Q_SLOTS:
     void onCursorFrame();
 
 private:
+    /* What the cursor currently shows, so that setting the same image again
+     * costs a comparison instead of a trip through wlr_cursor. */
+    struct Image
+    {
+        enum class Source {
+            None,
+            XCursor,
+            Surface,
+        };
+        Source source = Source::None;
+        QByteArray name;
+        wlr_surface *surface = nullptr;
+        QPoint hotspot;
+    };
+    /* Hit-tested once at touch down, wlroots keeps sending the point to
+     * the surface it went down on. Motion is sent on the touch frame, only
+     * the last position of each point. */
+    struct TouchPoint
+    {
+        /* Layout position of the surface origin at touch down. */
+        QPointF origin;
+        QPointF position;
+        uint32_t time = 0;
+        bool motionPending = false;
+    };
+    struct Constraint
+    {
+        wl_listener destroy;
+        QBoxCursor *cursor;
+        wlr_pointer_constraint_v1 *constraint;
+    };
+
+    void setXCursorImage(const char *name);
+    void setSurfaceImage(wlr_surface *surface, const QPoint &hotspot);
+    bool loadScales(QWXCursorManager *manager);
+    void onAnimationTimeout();
+
+    void onCursorConfigChanged();
+    void processRelativeMotion(wlr_pointer *pointer, uint32_t time, const QPointF &delta,
+                               const QPointF &unaccelerated);
     void processCursorMotion(uint32_t time);
+    void onNewConstraint(wlr_pointer_constraint_v1 *constraint);
+    void updateConstraint(wlr_surface *surface);
+    void setActiveConstraint(wlr_pointer_constraint_v1 *constraint);
+    void warpToCursorHint(wlr_pointer_constraint_v1 *constraint);
+    static void handleConstraintDestroy(wl_listener *listener, void *data);
     void processCursorMove();
     void processCursorResize();
+    void onTouchDown(wlr_touch_down_event *event);
+    void onTouchUp(wlr_touch_up_event *event);
+    void onTouchMotion(wlr_touch_motion_event *event);
+    void onTouchCancel(wlr_touch_cancel_event *event);
+    void onTouchFrame();
+    QPointF touchPosition(wlr_touch *touch, double x, double y) const;
+    /* Onto the closest output, from the cached layout boxes. */
+    void warpClosest(const QPointF &pos);
+    void emulatePointerButton(uint32_t time, bool pressed);
 
     QWSeat *getSeat();
 
     QWCursor *m_cursor;
     QWXCursorManager *m_cursorManager;
+    bool m_themeLoaded = false;
+    Image m_image;
+    QMetaObject::Connection m_imageSurfaceConnection;
+    QTimer *m_animationTimer;
+    int m_animationFrame = 0;
     CursorState cursorState = CursorState::Normal;
 
+    wlr_relative_pointer_manager_v1 *m_relativePointerManager;
+    wlr_pointer_constraints_v1 *m_pointerConstraints;
+    QWSignalConnector m_sc;
+    wlr_pointer_constraint_v1 *m_activeConstraint = nullptr;
+    /* Layout position of the surface with pointer focus. */
+    QPointF m_focusOrigin;
+    QHash<int32_t, TouchPoint> m_touchPoints;
+    /* The touch point driving the pointer, -1 for none. */
+    int32_t m_emulatedTouch = -1;
+
     QBoxServer *m_service;
 };
 
@@ -1,10 +1,67 @@
 #include "qboxdecoration.h"
 #include "qboxserver.h"
 
+#include <QFontMetrics>
+#include <QImage>
+#include <QPainter>
+
+#include <cmath>
+
 extern "C" {
+#include <drm_fourcc.h>
+#include <wlr/interfaces/wlr_buffer.h>
+#include <wlr/types/wlr_scene.h>
 #include <wlr/types/wlr_xdg_decoration_v1.h>
 }
 
+static constexpr int BorderWidth = 1;
+static constexpr int TitlePadding = 8;
+/* Longer titles are elided, which also bounds the size of the cache. */
+static constexpr int MaxTitleWidth = 1024;
+static constexpr int MaxCachedTitles = 64;
+
+static const float activeTitlebarColor[4] = { 0.2f, 0.3f, 0.45f, 1.0f };
+static const float inactiveTitlebarColor[4] = { 0.2f, 0.2f, 0.2f, 1.0f };
+static const float activeBorderColor[4] = { 0.3f, 0.5f, 0.8f, 1.0f };
+static const float inactiveBorderColor[4] = { 0.12f, 0.12f, 0.12f, 1.0f };
+
+namespace {
+/* Read only pixels for the scene, uploaded like any shm buffer. */
+struct TextBuffer
+{
+    wlr_buffer base;
+    QImage image;
+};
+}
+
+static void textBufferDestroy(wlr_buffer *buffer)
+{
+    delete reinterpret_cast<TextBuffer*>(buffer);
+}
+
+static bool textBufferBeginDataPtrAccess(wlr_buffer *buffer, uint32_t flags, void **data,
+                                         uint32_t *format, size_t *stride)
+{
+    if (flags & WLR_BUFFER_DATA_PTR_ACCESS_WRITE)
+        return false;
+    auto *self = reinterpret_cast<TextBuffer*>(buffer);
+    *data = const_cast<uchar*>(self->image.constBits());
+    /* QImage::Format_ARGB32_Premultiplied in memory order. */
+    *format = DRM_FORMAT_ARGB8888;
+    *stride = self->image.bytesPerLine();
+    return true;
+}
+
+static void textBufferEndDataPtrAccess(wlr_buffer *)
+{
+}
+
+static QBoxOutPut::View *viewOf(QWXdgToplevelDecorationV1 *decoration)
+{
+    auto *sceneTree = reinterpret_cast<QWSceneTree*>(decoration->handle()->toplevel->base->data);
+    return sceneTree ? reinterpret_cast<QBoxOutPut::View*>(sceneTree->handle()->node.data) : nullptr;
+}
+
 QBoxDecoration::QBoxDecoration(QBoxServer *server):
     m_server(server),
     decoratManager(QWXdgDecorationManagerV1::create(server->display)),
@@ -13,10 +70,83 @@ QBoxDecoration::QBoxDecoration(QBoxServer *server):
     if (decoratManager != nullptr) {
         connect(decoratManager, &QWXdgDecorationManagerV1::newToplevelDecoration, this, &QBoxDecoration::onNewToplevelDecoration);
     }
+    connect(server->xdgShell, &QBoxXdgShell::viewFocused, this, &QBoxDecoration::onViewFocused);
+    connect(server->config, &QBoxConfig::generalChanged, this, [this] {
+        for (Frame *frame : std::as_const(m_frames))
+            updateFrame(frame);
+    });
+}
+
+QBoxDecoration::~QBoxDecoration()
+{
+    /* Buffers still shown are freed once the scene lets go of them. */
+    for (wlr_buffer *buffer : std::as_const(m_titles))
+        wlr_buffer_drop(buffer);
+}
+
+QMargins QBoxDecoration::margins(View *view) const
+{
+    if (!m_frames.contains(view) || view->fullscreen)
+        return QMargins();
+    auto config = m_server->config->current();
+    return QMargins(BorderWidth, config->general.titlebarHeight + BorderWidth, BorderWidth, BorderWidth);
+}
+
+void QBoxDecoration::appendMemoryStatistics(QByteArray *out) const
+{
+    qint64 titleBytes = 0;
+    for (wlr_buffer *buffer : std::as_const(m_titles))
+        titleBytes += qint64(buffer->width) * buffer->height * 4;
+    *out += "memory.decoration.frames=" + QByteArray::number(m_frames.size()) + '\n';
+    *out += "memory.decoration.titles=" + QByteArray::number(m_titles.size()) + '\n';
+    *out += "memory.decoration.title_bytes=" + QByteArray::number(titleBytes) + '\n';
+}
+
+QBoxDecoration::View *QBoxDecoration::titlebarAt(const QPointF &pos) const
+{
+    QPointF spos;
+    auto *node = m_server->xdgShell->getScene()->at(pos, &spos);
+    if (!node)
+        return nullptr;
+    /* Same walk as QBoxXdgShell::viewAt, the frame is a child of the view tree. */
+    wlr_scene_tree *tree = node->parent;
+    while (tree && !tree->node.data)
+        tree = tree->node.parent;
+    if (!tree)
+        return nullptr;
+    Frame *frame = m_frames.value(reinterpret_cast<View*>(tree->node.data));
+    if (!frame)
+        return nullptr;
+    if (node == &frame->titlebar->node || (frame->title && node == &frame->title->node))
+        return frame->view;
+    return nullptr;
 }
 
 void QBoxDecoration::onNewToplevelDecoration(QWXdgToplevelDecorationV1 *toplevel_decoration)
 {
+    View *view = viewOf(toplevel_decoration);
+    if (!view)
+        return;
+    view->decoration = toplevel_decoration;
+
+    Owner owner { view };
+    owner.viewDestroyed = connect(view->xdgToplevel, &QObject::destroyed, this, [this, view, toplevel_decoration] {
+        m_owners.remove(toplevel_decoration);
+        destroyFrame(view);
+    });
+    m_owners.insert(toplevel_decoration, owner);
+    connect(toplevel_decoration, &QObject::destroyed, this, [this, toplevel_decoration] {
+        auto it = m_owners.find(toplevel_decoration);
+        if (it == m_owners.end())
+            return;
+        View *view = it->view;
+        disconnect(it->viewDestroyed);
+        m_owners.erase(it);
+        if (view->decoration == toplevel_decoration)
+            view->decoration = nullptr;
+        destroyFrame(view);
+    });
+
     connect(toplevel_decoration,
             &QWXdgToplevelDecorationV1::requestMode,
             this,
@@ -29,8 +159,216 @@ void QBoxDecoration::onNewToplevelDecoration(QWXdgToplevelDecorationV1 *toplevel
 void QBoxDecoration::onXdgDecorationMode()
 {
     auto *toplevel_decoration = qobject_cast<QWXdgToplevelDecorationV1*>(QObject::sender());
-    // do not support server-side decorations yet
-    toplevel_decoration->setMode(WLR_XDG_TOPLEVEL_DECORATION_V1_MODE_CLIENT_SIDE);
-    if (!m_server->views.empty())
-      m_server->views.last()->decoration = toplevel_decoration;
+    auto it = m_owners.constFind(toplevel_decoration);
+    if (it == m_owners.constEnd())
+        return;
+    /* Before the initial commit the mode is picked together with the
+     * placement, a configure can't be sent yet anyway. */
+    if (it->view->initialConfigured)
+        applyMode(it->view);
+}
+
+void QBoxDecoration::applyMode(View *view)
+{
+    QWXdgToplevelDecorationV1 *decoration = view->decoration;
+    if (!decoration) {
+        /* Clients not using the protocol draw their own. */
+        destroyFrame(view);
+        return;
+    }
+
+    auto config = m_server->config->current();
+    auto mode = decoration->handle()->requested_mode;
+    if (mode == WLR_XDG_TOPLEVEL_DECORATION_V1_MODE_NONE)
+        mode = WLR_XDG_TOPLEVEL_DECORATION_V1_MODE_SERVER_SIDE;
+    if (config->general.decorations == QBoxConfig::Decorations::Client)
+        mode = WLR_XDG_TOPLEVEL_DECORATION_V1_MODE_CLIENT_SIDE;
+    decoration->setMode(mode);
+
+    if (mode == WLR_XDG_TOPLEVEL_DECORATION_V1_MODE_SERVER_SIDE)
+        createFrame(view);
+    else
+        destroyFrame(view);
+}
+
+void QBoxDecoration::createFrame(View *view)
+{
+    if (m_frames.contains(view))
+        return;
+
+    auto *frame = new Frame;
+    frame->decoration = this;
+    frame->view = view;
+    frame->active = !m_server->views.isEmpty() && m_server->views.first() == view;
+
+    /* Below the surfaces, at window geometry coordinates of the view. */
+    frame->tree = wlr_scene_tree_create(view->sceneTree->handle());
+    wlr_scene_node_lower_to_bottom(&frame->tree->node);
+    const float *border = frame->active ? activeBorderColor : inactiveBorderColor;
+    for (wlr_scene_rect *&rect : frame->borders)
+        rect = wlr_scene_rect_create(frame->tree, 0, 0, border);
+    frame->titlebar = wlr_scene_rect_create(frame->tree, 0, 0,
+                                            frame->active ? activeTitlebarColor : inactiveTitlebarColor);
+    frame->title = wlr_scene_buffer_create(frame->tree, nullptr);
+
+    frame->treeDestroy.notify = &QBoxDecoration::handleTreeDestroy;
+    wl_signal_add(&frame->tree->node.events.destroy, &frame->treeDestroy);
+    frame->setTitle.notify = &QBoxDecoration::handleSetTitle;
+    wl_signal_add(&view->xdgToplevel->handle()->events.set_title, &frame->setTitle);
+    /* Follows the window geometry, which only changes on commit. */
+    frame->commit = connect(view->xdgToplevel->surface(), &QWSurface::commit, this, [this, frame] {
+        updateFrame(frame);
+    });
+    m_frames.insert(view, frame);
+    updateFrame(frame);
+}
+
+void QBoxDecoration::destroyFrame(View *view)
+{
+    /* The rest happens in handleTreeDestroy, which also covers the view
+     * tree going away first. */
+    if (Frame *frame = m_frames.value(view))
+        wlr_scene_node_destroy(&frame->tree->node);
+}
+
+void QBoxDecoration::handleTreeDestroy(wl_listener *listener, void *)
+{
+    Frame *frame = wl_container_of(listener, frame, treeDestroy);
+    wl_list_remove(&frame->treeDestroy.link);
+    wl_list_remove(&frame->setTitle.link);
+    disconnect(frame->commit);
+    frame->decoration->m_frames.remove(frame->view);
+    delete frame;
+}
+
+void QBoxDecoration::handleSetTitle(wl_listener *listener, void *)
+{
+    Frame *frame = wl_container_of(listener, frame, setTitle);
+    frame->titleDirty = true;
+    frame->decoration->updateFrame(frame);
+}
+
+void QBoxDecoration::onViewFocused(View *view)
+{
+    for (Frame *frame : std::as_const(m_frames)) {
+        const bool active = frame->view == view;
+        if (frame->active == active)
+            continue;
+        frame->active = active;
+        frame->titleDirty = true;
+        const float *border = active ? activeBorderColor : inactiveBorderColor;
+        for (wlr_scene_rect *rect : frame->borders)
+            wlr_scene_rect_set_color(rect, border);
+        wlr_scene_rect_set_color(frame->titlebar, active ? activeTitlebarColor : inactiveTitlebarColor);
+        updateFrame(frame);
+    }
+}
+
+void QBoxDecoration::updateFrame(Frame *frame)
+{
+    View *view = frame->view;
+    wlr_scene_node_set_enabled(&frame->tree->node, !view->fullscreen);
+    if (view->fullscreen)
+        return;
+
+    auto config = m_server->config->current();
+    const int titlebarHeight = qMax(0, config->general.titlebarHeight);
+    const QSize size = view->xdgToplevel->getGeometry().size();
+    const float scale = m_server->output->scale(m_server->xdgShell->getActiveOutput(view));
+    /* Most commits don't resize. */
+    if (size == frame->size && titlebarHeight == frame->titlebarHeight
+            && scale == frame->scale && !frame->titleDirty)
+        return;
+
+    const bool resized = size != frame->size || titlebarHeight != frame->titlebarHeight;
+    frame->size = size;
+    frame->titlebarHeight = titlebarHeight;
+    if (resized) {
+        const int w = size.width();
+        const int h = size.height();
+        const int t = titlebarHeight;
+        const int b = BorderWidth;
+        wlr_scene_rect_set_size(frame->titlebar, w, t);
+        wlr_scene_node_set_position(&frame->titlebar->node, 0, -t);
+        wlr_scene_rect_set_size(frame->borders[0], w + 2 * b, b);
+        wlr_scene_node_set_position(&frame->borders[0]->node, -b, -t - b);
+        wlr_scene_rect_set_size(frame->borders[1], w + 2 * b, b);
+        wlr_scene_node_set_position(&frame->borders[1]->node, -b, h);
+        wlr_scene_rect_set_size(frame->borders[2], b, h + t);
+        wlr_scene_node_set_position(&frame->borders[2]->node, -b, -t);
+        wlr_scene_rect_set_size(frame->borders[3], b, h + t);
+        wlr_scene_node_set_position(&frame->borders[3]->node, w, -t);
+    }
+    updateTitle(frame, scale);
+}
+
+void QBoxDecoration::updateTitle(Frame *frame, float scale)
+{
+    const char *title = frame->view->xdgToplevel->handle()->title;
+    TitleKey key { QString::fromUtf8(title ? title : ""), frame->titlebarHeight, scale, frame->active };
+    wlr_buffer *buffer = titleBuffer(key);
+    frame->titleDirty = false;
+    frame->scale = scale;
+
+    const int available = frame->size.width() - 2 * TitlePadding;
+    if (!buffer || available <= 0) {
+        wlr_scene_node_set_enabled(&frame->title->node, false);
+        return;
+    }
+    /* Shared buffers are never elided per view, narrow windows show the
+     * start of the title instead. */
+    const int width = qMin(int(std::ceil(buffer->width / scale)), available);
+    const wlr_fbox source { 0, 0, qMin(double(buffer->width), width * double(scale)), double(buffer->height) };
+    wlr_scene_buffer_set_buffer(frame->title, buffer);
+    wlr_scene_buffer_set_source_box(frame->title, &source);
+    wlr_scene_buffer_set_dest_size(frame->title, width, frame->titlebarHeight);
+    wlr_scene_node_set_position(&frame->title->node, TitlePadding, -frame->titlebarHeight);
+    wlr_scene_node_set_enabled(&frame->title->node, true);
+}
+
+wlr_buffer *QBoxDecoration::titleBuffer(const TitleKey &key)
+{
+    if (wlr_buffer *buffer = m_titles.value(key))
+        return buffer;
+
+    const int height = std::ceil(key.height * key.scale);
+    QFont font;
+    font.setPixelSize(std::round(height * 0.55));
+    if (key.text.isEmpty() || font.pixelSize() < 6)
+        return nullptr;
+    const QFontMetrics metrics(font);
+    const QString text = metrics.elidedText(key.text, Qt::ElideRight, std::ceil(MaxTitleWidth * key.scale));
+    const int width = metrics.horizontalAdvance(text);
+    if (width <= 0)
+        return nullptr;
+
+    /* Forget titles no view shows anymore before adding another one. */
+    if (m_titles.size() >= MaxCachedTitles) {
+        for (auto it = m_titles.begin(); it != m_titles.end();) {
+            if (it.value()->n_locks == 0) {
+                wlr_buffer_drop(it.value());
+                it = m_titles.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    auto *buffer = new TextBuffer;
+    buffer->image = QImage(width, height, QImage::Format_ARGB32_Premultiplied);
+    buffer->image.fill(Qt::transparent);
+    QPainter painter(&buffer->image);
+    painter.setFont(font);
+    painter.setPen(key.active ? QColor(Qt::white) : QColor(160, 160, 160));
+    painter.drawText(buffer->image.rect(), Qt::AlignLeft | Qt::AlignVCenter, text);
+    painter.end();
+
+    static const wlr_buffer_impl textBufferImpl = {
+        .destroy = textBufferDestroy,
+        .begin_data_ptr_access = textBufferBeginDataPtrAccess,
+        .end_data_ptr_access = textBufferEndDataPtrAccess,
+    };
+    wlr_buffer_init(&buffer->base, &textBufferImpl, width, height);
+    m_titles.insert(key, &buffer->base);
+    return &buffer->base;
 }
@@ -1,25 +1,98 @@
 #ifndef QBOXDECORATION_H
 #define QBOXDECORATION_H
 
+#include "qboxoutput.h"
+
 #include <qwxdgdecorationmanagerv1.h>
+#include <QHash>
+#include <QMargins>
+
+extern "C" {
+#include <wayland-server-core.h>
+}
+
+struct wlr_buffer;
+struct wlr_scene_tree;
+struct wlr_scene_rect;
+struct wlr_scene_buffer;
 
 class QBoxServer;
 
 using QW_NAMESPACE::QWXdgDecorationManagerV1;
 using QW_NAMESPACE::QWXdgToplevelDecorationV1;
 
+/* Server-side decorations are a few scene rects around the view plus a
+ * buffer holding the title text. Title buffers are cached by text, focus
+ * and scale and shared between views, windows showing the same title
+ * don't render it twice. */
 class QBoxDecoration : public QObject
 {
     Q_OBJECT
+    using View = QBoxOutPut::View;
 public:
     QBoxDecoration(QBoxServer *m_server);
+    ~QBoxDecoration();
+
+    /* Space taken around the window geometry of a decorated view. */
+    QMargins margins(View *view) const;
+    /* The view whose titlebar is at the given layout coordinates. */
+    View *titlebarAt(const QPointF &pos) const;
+    /* Called on the initial commit, before the view is placed. */
+    void applyMode(View *view);
+    void appendMemoryStatistics(QByteArray *out) const;
 
 private Q_SLOTS:
     void onNewToplevelDecoration(QWXdgToplevelDecorationV1 *decorat);
     void onXdgDecorationMode();
 
 private:
+    struct Owner
+    {
+        View *view;
+        QMetaObject::Connection viewDestroyed;
+    };
+    struct Frame
+    {
+        wl_listener treeDestroy;
+        wl_listener setTitle;
+        QBoxDecoration *decoration;
+        View *view;
+        wlr_scene_tree *tree;
+        wlr_scene_rect *titlebar;
+        wlr_scene_rect *borders[4];
+        wlr_scene_buffer *title;
+        QMetaObject::Connection commit;
+        QSize size;
+        int titlebarHeight = -1;
+        float scale = 0;
+        bool active = false;
+        bool titleDirty = true;
+    };
+    struct TitleKey
+    {
+        QString text;
+        int height;
+        float scale;
+        bool active;
+        bool operator==(const TitleKey &) const = default;
+        friend size_t qHash(const TitleKey &key, size_t seed = 0) {
+            return qHashMulti(seed, key.text, key.height, key.scale, key.active);
+        }
+    };
+
+    void createFrame(View *view);
+    void destroyFrame(View *view);
+    void updateFrame(Frame *frame);
+    void updateTitle(Frame *frame, float scale);
+    wlr_buffer *titleBuffer(const TitleKey &key);
+    void onViewFocused(View *view);
+    static void handleTreeDestroy(wl_listener *listener, void *data);
+    static void handleSetTitle(wl_listener *listener, void *data);
+
     QWXdgDecorationManagerV1 *decoratManager;
+    QHash<QWXdgToplevelDecorationV1*, Owner> m_owners;
+    QHash<View*, Frame*> m_frames;
+    QHash<TitleKey, wlr_buffer*> m_titles;
     QBoxServer *m_server;
 };
 
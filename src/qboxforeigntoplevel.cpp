@@ -0,0 +1,164 @@
+#include "qboxforeigntoplevel.h"
+#include "qboxserver.h"
+
+extern "C" {
+#include <wlr/config.h>
+#include <wlr/types/wlr_foreign_toplevel_management_v1.h>
+#if WLR_HAS_XWAYLAND
+#define class class_
+#include <wlr/xwayland.h>
+#undef class
+#endif
+}
+
+QBoxForeignToplevel::QBoxForeignToplevel(QBoxServer *server):
+    m_server(server),
+    QObject(server)
+{
+    m_manager = wlr_foreign_toplevel_manager_v1_create(server->display->handle());
+    connect(server->xdgShell, &QBoxXdgShell::viewMapped, this, &QBoxForeignToplevel::onViewMapped);
+    connect(server->xdgShell, &QBoxXdgShell::viewUnmapped, this, &QBoxForeignToplevel::onViewUnmapped);
+    /* Activation moves from one view to another, both need an update. */
+    connect(server->xdgShell, &QBoxXdgShell::viewFocused, this, [this] {
+        for (View *view : std::as_const(m_server->views)) {
+            Toplevel *toplevel = m_toplevels.value(view);
+            if (toplevel && toplevel->activated != (view == m_server->views.first()))
+                markDirty(view);
+        }
+    });
+    connect(server->xdgShell, &QBoxXdgShell::viewFullscreenChanged, this, &QBoxForeignToplevel::markDirty);
+    /* Output enter and leave, flush() only sends them if the output the view
+     * is on actually changed. */
+    connect(server->xdgShell, &QBoxXdgShell::viewMoved, this, &QBoxForeignToplevel::markDirty);
+    connect(server->output, &QBoxOutPut::layoutChanged, this, [this] {
+        for (View *view : std::as_const(m_server->views))
+            markDirty(view);
+    });
+}
+
+void QBoxForeignToplevel::onViewMapped(View *view)
+{
+    auto *toplevel = new Toplevel;
+    toplevel->manager = this;
+    toplevel->view = view;
+    toplevel->handle = wlr_foreign_toplevel_handle_v1_create(m_manager);
+
+    toplevel->setTitle.notify = &QBoxForeignToplevel::handleSetTitle;
+    toplevel->setAppId.notify = &QBoxForeignToplevel::handleSetAppId;
+#if WLR_HAS_XWAYLAND
+    if (view->xwaylandSurface) {
+        wl_signal_add(&view->xwaylandSurface->events.set_title, &toplevel->setTitle);
+        wl_signal_add(&view->xwaylandSurface->events.set_class, &toplevel->setAppId);
+    } else
+#endif
+    {
+        wl_signal_add(&view->xdgToplevel->handle()->events.set_title, &toplevel->setTitle);
+        wl_signal_add(&view->xdgToplevel->handle()->events.set_app_id, &toplevel->setAppId);
+    }
+    toplevel->requestActivate.notify = &QBoxForeignToplevel::handleRequestActivate;
+    wl_signal_add(&toplevel->handle->events.request_activate, &toplevel->requestActivate);
+    toplevel->requestClose.notify = &QBoxForeignToplevel::handleRequestClose;
+    wl_signal_add(&toplevel->handle->events.request_close, &toplevel->requestClose);
+    toplevel->requestFullscreen.notify = &QBoxForeignToplevel::handleRequestFullscreen;
+    wl_signal_add(&toplevel->handle->events.request_fullscreen, &toplevel->requestFullscreen);
+
+    m_toplevels.insert(view, toplevel);
+    markDirty(view);
+}
+
+void QBoxForeignToplevel::onViewUnmapped(View *view)
+{
+    Toplevel *toplevel = m_toplevels.take(view);
+    if (!toplevel)
+        return;
+    m_dirty.removeOne(toplevel);
+    wl_list_remove(&toplevel->setTitle.link);
+    wl_list_remove(&toplevel->setAppId.link);
+    wl_list_remove(&toplevel->requestActivate.link);
+    wl_list_remove(&toplevel->requestClose.link);
+    wl_list_remove(&toplevel->requestFullscreen.link);
+    wlr_foreign_toplevel_handle_v1_destroy(toplevel->handle);
+    delete toplevel;
+}
+
+void QBoxForeignToplevel::markDirty(View *view)
+{
+    Toplevel *toplevel = m_toplevels.value(view);
+    if (!toplevel || m_dirty.contains(toplevel))
+        return;
+    m_dirty.append(toplevel);
+    if (m_flushPending)
+        return;
+    m_flushPending = true;
+    QMetaObject::invokeMethod(this, &QBoxForeignToplevel::flush, Qt::QueuedConnection);
+}
+
+void QBoxForeignToplevel::flush()
+{
+    /* wlroots follows the changes of a handle with a single done. */
+    m_flushPending = false;
+    const QList<Toplevel*> dirty = std::exchange(m_dirty, {});
+    for (Toplevel *toplevel : dirty) {
+        View *view = toplevel->view;
+        const QByteArray title = view->title();
+        if (title != toplevel->title) {
+            toplevel->title = title;
+            wlr_foreign_toplevel_handle_v1_set_title(toplevel->handle, title.constData());
+        }
+        const QByteArray appId = view->appId();
+        if (appId != toplevel->appId) {
+            toplevel->appId = appId;
+            wlr_foreign_toplevel_handle_v1_set_app_id(toplevel->handle, appId.constData());
+        }
+        const bool activated = view == m_server->views.first();
+        if (activated != toplevel->activated) {
+            toplevel->activated = activated;
+            wlr_foreign_toplevel_handle_v1_set_activated(toplevel->handle, activated);
+        }
+        if (view->fullscreen != toplevel->fullscreen) {
+            toplevel->fullscreen = view->fullscreen;
+            wlr_foreign_toplevel_handle_v1_set_fullscreen(toplevel->handle, view->fullscreen);
+        }
+        /* A drag marks the view dirty on every motion, this runs once. */
+        QWOutput *output = m_server->xdgShell->getActiveOutput(view);
+        if (output != toplevel->output) {
+            if (toplevel->output)
+                wlr_foreign_toplevel_handle_v1_output_leave(toplevel->handle, toplevel->output->handle());
+            if (output)
+                wlr_foreign_toplevel_handle_v1_output_enter(toplevel->handle, output->handle());
+            toplevel->output = output;
+        }
+    }
+}
+
+void QBoxForeignToplevel::handleSetTitle(wl_listener *listener, void *)
+{
+    Toplevel *toplevel = wl_container_of(listener, toplevel, setTitle);
+    toplevel->manager->markDirty(toplevel->view);
+}
+
+void QBoxForeignToplevel::handleSetAppId(wl_listener *listener, void *)
+{
+    Toplevel *toplevel = wl_container_of(listener, toplevel, setAppId);
+    toplevel->manager->markDirty(toplevel->view);
+}
+
+void QBoxForeignToplevel::handleRequestActivate(wl_listener *listener, void *)
+{
+    Toplevel *toplevel = wl_container_of(listener, toplevel, requestActivate);
+    View *view = toplevel->view;
+    toplevel->manager->m_server->xdgShell->focusView(view, view->surface());
+}
+
+void QBoxForeignToplevel::handleRequestClose(wl_listener *listener, void *)
+{
+    Toplevel *toplevel = wl_container_of(listener, toplevel, requestClose);
+    toplevel->view->close();
+}
+
+void QBoxForeignToplevel::handleRequestFullscreen(wl_listener *listener, void *data)
+{
+    Toplevel *toplevel = wl_container_of(listener, toplevel, requestFullscreen);
+    auto *event = static_cast<wlr_foreign_toplevel_handle_v1_fullscreen_event*>(data);
+    toplevel->manager->m_server->xdgShell->setFullscreen(toplevel->view, event->fullscreen);
+}
@@ -0,0 +1,70 @@
+#ifndef QBOXFOREIGNTOPLEVEL_H
+#define QBOXFOREIGNTOPLEVEL_H
+
+#include "qboxoutput.h"
+
+#include <QObject>
+#include <QHash>
+#include <QPointer>
+
+extern "C" {
+#include <wayland-server-core.h>
+}
+
+struct wlr_foreign_toplevel_manager_v1;
+struct wlr_foreign_toplevel_handle_v1;
+
+class QBoxServer;
+
+/* wlr-foreign-toplevel-management, for taskbars and docks.
+ *
+ * Mapped views get a handle. Changes only mark the view dirty, the state
+ * is sent once per event loop iteration and only what differs from what
+ * panels were last told: a terminal retitling itself for every command
+ * costs one title event and one done per iteration, not one per change. */
+class QBoxForeignToplevel : public QObject
+{
+    Q_OBJECT
+    using View = QBoxOutPut::View;
+public:
+    explicit QBoxForeignToplevel(QBoxServer *server);
+
+private:
+    struct Toplevel
+    {
+        wl_listener setTitle;
+        wl_listener setAppId;
+        wl_listener requestActivate;
+        wl_listener requestClose;
+        wl_listener requestFullscreen;
+        QBoxForeignToplevel *manager;
+        View *view;
+        wlr_foreign_toplevel_handle_v1 *handle;
+        /* What panels were last told. */
+        QByteArray title;
+        QByteArray appId;
+        /* wlroots drops an output that goes away by itself. */
+        QPointer<QWOutput> output;
+        bool activated = false;
+        bool fullscreen = false;
+    };
+
+    void onViewMapped(View *view);
+    void onViewUnmapped(View *view);
+    void markDirty(View *view);
+    void flush();
+    static void handleSetTitle(wl_listener *listener, void *data);
+    static void handleSetAppId(wl_listener *listener, void *data);
+    static void handleRequestActivate(wl_listener *listener, void *data);
+    static void handleRequestClose(wl_listener *listener, void *data);
+    static void handleRequestFullscreen(wl_listener *listener, void *data);
+
+    wlr_foreign_toplevel_manager_v1 *m_manager;
+    QHash<View*, Toplevel*> m_toplevels;
+    QList<Toplevel*> m_dirty;
+    bool m_flushPending = false;
+
+    QBoxServer *m_server;
+};
+
+#endif // QBOXFOREIGNTOPLEVEL_H
@@ -0,0 +1,68 @@
+#include "qboxframescheduler.h"
+
+#include <ctime>
+
+QBoxFrameScheduler::QBoxFrameScheduler(const QByteArray &name):
+    m_name(name)
+{
+}
+
+qint64 QBoxFrameScheduler::monotonicNow()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return qint64(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+void QBoxFrameScheduler::setRefreshRange(int minRefresh, int maxRefresh)
+{
+    m_minInterval = maxRefresh > 0 ? 1000000000000LL / maxRefresh : 0;
+    m_maxInterval = minRefresh > 0 ? 1000000000000LL / minRefresh : 0;
+}
+
+qint64 QBoxFrameScheduler::contentCommitted()
+{
+    /* Never go faster than the display's highest refresh rate, otherwise
+     * present as soon as the client is done. */
+    const qint64 elapsed = monotonicNow() - m_lastPresent;
+    if (elapsed >= m_minInterval)
+        return 0;
+    ++m_statsDeferred;
+    return m_minInterval - elapsed;
+}
+
+void QBoxFrameScheduler::presented()
+{
+    const qint64 now = monotonicNow();
+    if (m_lastPresent) {
+        const qint64 interval = now - m_lastPresent;
+        if (!m_statsMinInterval || interval < m_statsMinInterval)
+            m_statsMinInterval = interval;
+        if (interval > m_statsMaxInterval)
+            m_statsMaxInterval = interval;
+    }
+    m_lastPresent = now;
+    ++m_statsFrames;
+
+    if (m_statsInterval > 0) {
+        if (!m_statsStart)
+            m_statsStart = now;
+        else if (now - m_statsStart >= m_statsInterval)
+            logStatistics(now);
+    }
+}
+
+void QBoxFrameScheduler::logStatistics(qint64 now)
+{
+    const double seconds = (now - m_statsStart) / 1e9;
+    qInfo("%s: %.1f fps, frame interval %.2f..%.2f ms (range %.2f..%.2f ms), %d deferred",
+          m_name.constData(), m_statsFrames / seconds,
+          m_statsMinInterval / 1e6, m_statsMaxInterval / 1e6,
+          m_minInterval / 1e6, m_maxInterval / 1e6, m_statsDeferred);
+
+    m_statsStart = now;
+    m_statsFrames = 0;
+    m_statsDeferred = 0;
+    m_statsMinInterval = 0;
+    m_statsMaxInterval = 0;
+}
@@ -0,0 +1,48 @@
+#ifndef QBOXFRAMESCHEDULER_H
+#define QBOXFRAMESCHEDULER_H
+
+#include <QtGlobal>
+#include <QByteArray>
+
+/* Decides when an adaptive sync output should be rendered. With a fixed
+ * refresh rate the backend's frame events pace everything; with VRR the
+ * output follows the commits of the client driving it, no faster than the
+ * highest refresh rate of the display. Holding a frame on screen for at most
+ * the lowest one is up to the panel, which repeats it by itself; that bound
+ * only shows up in the statistics. */
+class QBoxFrameScheduler
+{
+public:
+    explicit QBoxFrameScheduler(const QByteArray &name);
+
+    static qint64 monotonicNow(); // nanoseconds
+
+    void setRefreshRange(int minRefresh, int maxRefresh); // mHz
+    void setStatisticsInterval(qint64 interval) {
+        m_statsInterval = interval;
+    }
+
+    /* The client driving the refresh rate committed new content. Returns
+     * the delay in ns after which the output should be rendered, 0 meaning
+     * right away. */
+    qint64 contentCommitted();
+    /* A frame reached the screen. */
+    void presented();
+
+private:
+    void logStatistics(qint64 now);
+
+    QByteArray m_name;
+    qint64 m_minInterval = 0;
+    qint64 m_maxInterval = 0;
+    qint64 m_lastPresent = 0;
+
+    qint64 m_statsInterval = 0;
+    qint64 m_statsStart = 0;
+    int m_statsFrames = 0;
+    int m_statsDeferred = 0;
+    qint64 m_statsMinInterval = 0;
+    qint64 m_statsMaxInterval = 0;
+};
+
+#endif // QBOXFRAMESCHEDULER_H
@@ -0,0 +1,106 @@
+#include "qboxidle.h"
+#include "qboxserver.h"
+
+extern "C" {
+#include <wlr/types/wlr_idle_notify_v1.h>
+#include <wlr/types/wlr_idle_inhibit_v1.h>
+#include <wlr/types/wlr_output_power_management_v1.h>
+}
+
+/* Idle timeouts are counted in seconds, passing activity on more often than
+ * this buys nothing. */
+static constexpr int ActivityInterval = 250; // ms
+
+QBoxIdle::QBoxIdle(QBoxServer *server):
+    m_server(server),
+    QObject(server)
+{
+    m_notifier = wlr_idle_notifier_v1_create(server->display->handle());
+    m_inhibitManager = wlr_idle_inhibit_v1_create(server->display->handle());
+    m_powerManager = wlr_output_power_manager_v1_create(server->display->handle());
+    m_sc.connect(&m_inhibitManager->events.new_inhibitor, this, &QBoxIdle::onNewInhibitor);
+    m_sc.connect(&m_powerManager->events.set_mode, this, &QBoxIdle::onSetOutputPowerMode);
+
+    m_activityTimer = new QTimer(this);
+    m_activityTimer->setSingleShot(true);
+    m_activityTimer->setInterval(ActivityInterval);
+    connect(m_activityTimer, &QTimer::timeout, this, [this] {
+        if (m_activityPending)
+            flushActivity();
+    });
+
+    m_idleTimer = new QTimer(this);
+    m_idleTimer->setSingleShot(true);
+    connect(m_idleTimer, &QTimer::timeout, this, &QBoxIdle::onIdleTimeout);
+    connect(server->config, &QBoxConfig::generalChanged, this, &QBoxIdle::onGeneralChanged);
+    onGeneralChanged();
+}
+
+void QBoxIdle::flushActivity()
+{
+    m_activityPending = false;
+    m_activityTimer->start();
+
+    wlr_idle_notifier_v1_notify_activity(m_notifier, m_server->seat->m_seat->handle());
+    if (m_idleTimer->interval() > 0 && !m_inhibitors)
+        m_idleTimer->start();
+    if (m_idle) {
+        m_idle = false;
+        m_server->output->setIdle(false);
+    }
+}
+
+void QBoxIdle::onIdleTimeout()
+{
+    if (m_inhibitors)
+        return;
+    m_idle = true;
+    m_server->output->setIdle(true);
+}
+
+void QBoxIdle::onGeneralChanged()
+{
+    auto config = m_server->config->current();
+    m_idleTimer->setInterval(config->general.idleTimeout * 1000);
+    if (config->general.idleTimeout > 0 && !m_inhibitors)
+        m_idleTimer->start();
+    else
+        m_idleTimer->stop();
+}
+
+void QBoxIdle::onNewInhibitor(wlr_idle_inhibitor_v1 *inhibitor)
+{
+    auto *data = new Inhibitor;
+    data->idle = this;
+    data->destroy.notify = &QBoxIdle::handleInhibitorDestroy;
+    wl_signal_add(&inhibitor->events.destroy, &data->destroy);
+
+    if (m_inhibitors++ == 0)
+        setInhibited(true);
+}
+
+void QBoxIdle::handleInhibitorDestroy(wl_listener *listener, void *)
+{
+    Inhibitor *data = wl_container_of(listener, data, destroy);
+    QBoxIdle *idle = data->idle;
+    wl_list_remove(&listener->link);
+    delete data;
+
+    if (--idle->m_inhibitors == 0)
+        idle->setInhibited(false);
+}
+
+void QBoxIdle::setInhibited(bool inhibited)
+{
+    wlr_idle_notifier_v1_set_inhibited(m_notifier, inhibited);
+    if (inhibited)
+        m_idleTimer->stop();
+    else if (m_idleTimer->interval() > 0)
+        m_idleTimer->start();
+}
+
+void QBoxIdle::onSetOutputPowerMode(wlr_output_power_v1_set_mode_event *event)
+{
+    m_server->output->setPowered(QWOutput::from(event->output),
+                                 event->mode == ZWLR_OUTPUT_POWER_V1_MODE_ON);
+}
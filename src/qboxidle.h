@@ -0,0 +1,71 @@
+#ifndef QBOXIDLE_H
+#define QBOXIDLE_H
+
+#include <qwsignalconnector.h>
+#include <QObject>
+#include <QTimer>
+
+extern "C" {
+#include <wayland-server-core.h>
+}
+
+struct wlr_idle_notifier_v1;
+struct wlr_idle_inhibit_manager_v1;
+struct wlr_idle_inhibitor_v1;
+struct wlr_output_power_manager_v1;
+struct wlr_output_power_v1_set_mode_event;
+
+using QW_NAMESPACE::QWSignalConnector;
+
+class QBoxServer;
+
+/* Tracks user activity for ext-idle-notify, honours idle inhibitors and
+ * powers the outputs down after [general] idle_timeout seconds, or whenever
+ * a client asks for it through wlr-output-power-management. */
+class QBoxIdle : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QBoxIdle(QBoxServer *server);
+
+    /* Called from the input paths for every event. Cheap: at most one
+     * notification is passed on per ActivityInterval. */
+    inline void notifyActivity() {
+        if (m_activityPending)
+            return;
+        if (m_activityTimer->isActive())
+            m_activityPending = true;
+        else
+            flushActivity();
+    }
+
+private:
+    void flushActivity();
+    void onIdleTimeout();
+    void onGeneralChanged();
+    void onNewInhibitor(wlr_idle_inhibitor_v1 *inhibitor);
+    void onSetOutputPowerMode(wlr_output_power_v1_set_mode_event *event);
+    void setInhibited(bool inhibited);
+
+    struct Inhibitor
+    {
+        wl_listener destroy;
+        QBoxIdle *idle;
+    };
+    static void handleInhibitorDestroy(wl_listener *listener, void *data);
+
+    wlr_idle_notifier_v1 *m_notifier;
+    wlr_idle_inhibit_manager_v1 *m_inhibitManager;
+    wlr_output_power_manager_v1 *m_powerManager;
+    QWSignalConnector m_sc;
+
+    QTimer *m_activityTimer;
+    QTimer *m_idleTimer;
+    bool m_activityPending = false;
+    bool m_idle = false;
+    int m_inhibitors = 0;
+
+    QBoxServer *m_server;
+};
+
+#endif // QBOXIDLE_H
@@ -0,0 +1,488 @@
+#include "qboxipc.h"
+#include "qboxserver.h"
+
+#include <QProcess>
+#include <QSocketNotifier>
+
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+/* Events are dropped rather than buffered once a subscriber falls this far
+ * behind, so a stalled client never makes the compositor wait or grow. */
+static constexpr qsizetype EventBufferLimit = 256 * 1024;
+/* Replies are never dropped, a client that stops reading them is kicked. */
+static constexpr qsizetype ReplyBufferLimit = 4 * 1024 * 1024;
+
+QBoxIpc::QBoxIpc(QBoxServer *server):
+    m_server(server),
+    QObject(server)
+{
+    auto appId = [](View *view) {
+        return view->appId();
+    };
+    connect(server->xdgShell, &QBoxXdgShell::viewMapped, this, [this, appId](View *view) {
+        broadcastEvent(QBOX_IPC_EVENT_MAP, view->id, appId(view));
+    });
+    connect(server->xdgShell, &QBoxXdgShell::viewUnmapped, this, [this, appId](View *view) {
+        broadcastEvent(QBOX_IPC_EVENT_UNMAP, view->id, appId(view));
+    });
+    connect(server->xdgShell, &QBoxXdgShell::viewFocused, this, [this, appId](View *view) {
+        broadcastEvent(QBOX_IPC_EVENT_FOCUS, view->id, appId(view));
+    });
+    connect(server->output, &QBoxOutPut::outputAdded, this, [this](QWOutput *output) {
+        const QByteArray name(output->handle()->name);
+        broadcastEvent(QBOX_IPC_EVENT_OUTPUT_ADD, 0, name);
+        connect(output, &QObject::destroyed, this, [this, name] {
+            broadcastEvent(QBOX_IPC_EVENT_OUTPUT_REMOVE, 0, name);
+        });
+    });
+}
+
+QBoxIpc::~QBoxIpc()
+{
+    while (!m_clients.isEmpty())
+        destroyClient(m_clients.first());
+
+    if (m_fd >= 0) {
+        close(m_fd);
+        unlink(m_path.constData());
+    }
+}
+
+bool QBoxIpc::start(const QByteArray &path)
+{
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= qsizetype(sizeof(addr.sun_path))) {
+        qWarning("IPC socket path is too long: %s", path.constData());
+        return false;
+    }
+    memcpy(addr.sun_path, path.constData(), path.size());
+
+    m_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_fd < 0) {
+        qWarning("failed to create IPC socket: %s", strerror(errno));
+        return false;
+    }
+
+    unlink(path.constData());
+    if (bind(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0
+            || listen(m_fd, SOMAXCONN) < 0) {
+        qWarning("failed to listen on IPC socket %s: %s", path.constData(), strerror(errno));
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_path = path;
+
+    m_listenNotifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    connect(m_listenNotifier, &QSocketNotifier::activated, this, &QBoxIpc::onNewConnection);
+    return true;
+}
+
+void QBoxIpc::onNewConnection()
+{
+    int fd;
+    while ((fd = accept4(m_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        auto *client = new Client;
+        client->fd = fd;
+        client->readNotifier = new QSocketNotifier(fd, QSocketNotifier::Read, this);
+        client->writeNotifier = new QSocketNotifier(fd, QSocketNotifier::Write, this);
+        client->writeNotifier->setEnabled(false);
+        connect(client->readNotifier, &QSocketNotifier::activated, this, [this, client] {
+            onClientReadable(client);
+        });
+        connect(client->writeNotifier, &QSocketNotifier::activated, this, [this, client] {
+            onClientWritable(client);
+        });
+        m_clients.append(client);
+    }
+}
+
+void QBoxIpc::onClientReadable(Client *client)
+{
+    if (client->dead)
+        return;
+    bool hangup = false;
+    char buffer[16384];
+    for (;;) {
+        ssize_t n = read(client->fd, buffer, sizeof(buffer));
+        if (n > 0) {
+            client->in.append(buffer, n);
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            break;
+        hangup = true;
+        break;
+    }
+    /* Whatever it still sent, nobody is left to get the replies. */
+    if (hangup) {
+        destroyClient(client);
+        return;
+    }
+
+    /* Handle every complete message that arrived, a client may pipeline
+     * several batches in one write. */
+    qsizetype offset = 0;
+    while (client->in.size() - offset >= qsizetype(sizeof(qbox_ipc_header))) {
+        qbox_ipc_header header;
+        memcpy(&header, client->in.constData() + offset, sizeof(header));
+        if (header.length > QBOX_IPC_MAX_MESSAGE_LENGTH) {
+            destroyClient(client);
+            return;
+        }
+        if (client->in.size() - offset - qsizetype(sizeof(header)) < qsizetype(header.length))
+            break;
+
+        const char *payload = client->in.constData() + offset + sizeof(header);
+        const bool ok = handleMessage(client, header.type, payload, header.length);
+        /* An event broadcast while handling it failed to reach the client. */
+        if (client->dead)
+            return;
+        if (!ok) {
+            destroyClient(client);
+            return;
+        }
+        offset += sizeof(header) + header.length;
+    }
+    client->in.remove(0, offset);
+
+    if (!flush(client))
+        destroyClient(client);
+}
+
+void QBoxIpc::onClientWritable(Client *client)
+{
+    if (client->dead)
+        return;
+    if (!flush(client))
+        destroyClient(client);
+}
+
+void QBoxIpc::destroyClient(Client *client)
+{
+    m_clients.removeOne(client);
+    client->readNotifier->setEnabled(false);
+    client->writeNotifier->setEnabled(false);
+    /* We may be inside one of the notifiers' activated() signal. */
+    client->readNotifier->deleteLater();
+    client->writeNotifier->deleteLater();
+    close(client->fd);
+    delete client;
+}
+
+void QBoxIpc::markDead(Client *client)
+{
+    if (client->dead)
+        return;
+    client->dead = true;
+    client->readNotifier->setEnabled(false);
+    client->writeNotifier->setEnabled(false);
+    if (m_reapPending)
+        return;
+    m_reapPending = true;
+    QMetaObject::invokeMethod(this, &QBoxIpc::reapClients, Qt::QueuedConnection);
+}
+
+void QBoxIpc::reapClients()
+{
+    m_reapPending = false;
+    const QList<Client*> clients = m_clients;
+    for (Client *client : clients) {
+        if (client->dead)
+            destroyClient(client);
+    }
+}
+
+bool QBoxIpc::handleMessage(Client *client, uint16_t type, const char *data, uint32_t length)
+{
+    switch (type) {
+    case QBOX_IPC_MSG_BATCH:
+        handleBatch(client, data, length);
+        return client->out.size() <= ReplyBufferLimit;
+    case QBOX_IPC_MSG_SUBSCRIBE:
+        if (length != sizeof(uint32_t))
+            return false;
+        memcpy(&client->eventMask, data, sizeof(uint32_t));
+        return true;
+    case QBOX_IPC_MSG_GET_STATS: {
+        QByteArray stats;
+        m_server->appendStatistics(&stats);
+        m_server->output->appendStatistics(&stats);
+        m_server->clients->appendStatistics(&stats);
+        return queueMessage(client, QBOX_IPC_MSG_STATS, stats);
+    }
+    case QBOX_IPC_MSG_GET_MEMORY: {
+        /* Walks everything, only ever done when asked. */
+        QByteArray memory;
+        m_server->appendMemoryStatistics(&memory);
+        m_server->xdgShell->appendMemoryStatistics(&memory);
+        m_server->decoration->appendMemoryStatistics(&memory);
+        m_server->cursor->appendMemoryStatistics(&memory);
+        m_server->seat->appendMemoryStatistics(&memory);
+        m_server->clients->appendMemoryStatistics(&memory);
+        return queueMessage(client, QBOX_IPC_MSG_MEMORY, memory);
+    }
+    default:
+        qWarning("unknown IPC message type %u", type);
+        return false;
+    }
+}
+
+void QBoxIpc::handleBatch(Client *client, const char *data, uint32_t length)
+{
+    /* Commands are staged first and only applied once the whole batch has
+     * been validated. Each view then gets at most one position update and
+     * one configure, however many commands touched it. */
+    struct Pending
+    {
+        QPoint position;
+        QSize size;
+        bool move = false;
+        bool resize = false;
+        bool close = false;
+    };
+    struct CreateOutput
+    {
+        QSize size;
+        int refresh;
+        /* Only known to fail once carried out. */
+        qsizetype status;
+    };
+    struct ViewArgs
+    {
+        uint32_t view;
+        int32_t x;
+        int32_t y;
+    };
+
+    QByteArray status;
+    QHash<View*, Pending> pending;
+    View *focus = nullptr;
+    QList<QString> spawns;
+    QList<CreateOutput> createOutputs;
+    QList<QString> destroyOutputs;
+    bool failed = false;
+
+    uint32_t offset = 0;
+    while (offset < length) {
+        qbox_ipc_command command;
+        if (length - offset < sizeof(command)) {
+            status.append(char(QBOX_IPC_STATUS_BAD_ARGS));
+            failed = true;
+            break;
+        }
+        memcpy(&command, data + offset, sizeof(command));
+        offset += sizeof(command);
+        if (command.length > length - offset) {
+            status.append(char(QBOX_IPC_STATUS_BAD_ARGS));
+            failed = true;
+            break;
+        }
+        const char *args = data + offset;
+        offset += command.length;
+
+        ViewArgs viewArgs {};
+        View *view = nullptr;
+        switch (command.op) {
+        case QBOX_IPC_OP_FOCUS:
+        case QBOX_IPC_OP_CLOSE:
+        case QBOX_IPC_OP_MOVE:
+        case QBOX_IPC_OP_RESIZE: {
+            const uint32_t expected = (command.op == QBOX_IPC_OP_FOCUS || command.op == QBOX_IPC_OP_CLOSE)
+                    ? sizeof(uint32_t) : sizeof(ViewArgs);
+            if (command.length != expected) {
+                status.append(char(QBOX_IPC_STATUS_BAD_ARGS));
+                failed = true;
+                continue;
+            }
+            memcpy(&viewArgs, args, command.length);
+            view = m_server->xdgShell->findView(viewArgs.view);
+            if (!view) {
+                status.append(char(QBOX_IPC_STATUS_UNKNOWN_VIEW));
+                failed = true;
+                continue;
+            }
+            break;
+        }
+        default:
+            break;
+        }
+
+        switch (command.op) {
+        case QBOX_IPC_OP_FOCUS:
+            focus = view;
+            break;
+        case QBOX_IPC_OP_CLOSE:
+            pending[view].close = true;
+            break;
+        case QBOX_IPC_OP_MOVE:
+            pending[view].position = QPoint(viewArgs.x, viewArgs.y);
+            pending[view].move = true;
+            break;
+        case QBOX_IPC_OP_RESIZE:
+            if (viewArgs.x <= 0 || viewArgs.y <= 0) {
+                status.append(char(QBOX_IPC_STATUS_BAD_ARGS));
+                failed = true;
+                continue;
+            }
+            pending[view].size = QSize(viewArgs.x, viewArgs.y);
+            pending[view].resize = true;
+            break;
+        case QBOX_IPC_OP_SPAWN:
+            if (command.length == 0) {
+                status.append(char(QBOX_IPC_STATUS_BAD_ARGS));
+                failed = true;
+                continue;
+            }
+            spawns.append(QString::fromUtf8(args, command.length));
+            break;
+        case QBOX_IPC_OP_OUTPUT_CREATE: {
+            int32_t mode[3];
+            if (command.length != sizeof(mode)) {
+                status.append(char(QBOX_IPC_STATUS_BAD_ARGS));
+                failed = true;
+                continue;
+            }
+            memcpy(mode, args, sizeof(mode));
+            if (mode[0] <= 0 || mode[1] <= 0 || mode[2] < 0) {
+                status.append(char(QBOX_IPC_STATUS_BAD_ARGS));
+                failed = true;
+                continue;
+            }
+            if (!m_server->output->canCreateVirtualOutputs()) {
+                status.append(char(QBOX_IPC_STATUS_UNSUPPORTED));
+                failed = true;
+                continue;
+            }
+            createOutputs.append({ QSize(mode[0], mode[1]), mode[2], status.size() });
+            break;
+        }
+        case QBOX_IPC_OP_OUTPUT_DESTROY: {
+            const QString name = QString::fromUtf8(args, command.length);
+            if (!m_server->output->isVirtualOutput(name) || destroyOutputs.contains(name)) {
+                status.append(char(QBOX_IPC_STATUS_UNKNOWN_OUTPUT));
+                failed = true;
+                continue;
+            }
+            destroyOutputs.append(name);
+            break;
+        }
+        case QBOX_IPC_OP_WORKSPACE:
+            /* qwlbox has no workspaces (yet). */
+            status.append(char(QBOX_IPC_STATUS_UNSUPPORTED));
+            failed = true;
+            continue;
+        default:
+            status.append(char(QBOX_IPC_STATUS_UNKNOWN_OP));
+            failed = true;
+            continue;
+        }
+        status.append(char(QBOX_IPC_STATUS_OK));
+    }
+
+    if (failed) {
+        for (char &s : status) {
+            if (s == QBOX_IPC_STATUS_OK)
+                s = QBOX_IPC_STATUS_ABORTED;
+        }
+        queueMessage(client, QBOX_IPC_MSG_REPLY, status);
+        return;
+    }
+
+    for (auto it = pending.cbegin(); it != pending.cend(); ++it) {
+        View *view = it.key();
+        if (it->move) {
+            view->geometry.moveTopLeft(it->position);
+            view->sceneTree->setPosition(view->geometry.topLeft());
+            view->syncPosition();
+        }
+        if (it->resize) {
+            view->geometry.setSize(it->size);
+            view->setSize(it->size);
+        }
+        if (it->move || it->resize)
+            Q_EMIT m_server->xdgShell->viewMoved(view);
+        if (it->close)
+            view->close();
+    }
+    if (focus)
+        m_server->xdgShell->focusView(focus, focus->surface());
+    for (const QString &name : std::as_const(destroyOutputs))
+        m_server->output->destroyVirtualOutput(name);
+    for (const CreateOutput &create : std::as_const(createOutputs)) {
+        if (!m_server->output->createVirtualOutput(create.size, create.refresh)) {
+            qWarning("failed to create a %dx%d virtual output", create.size.width(), create.size.height());
+            status[create.status] = char(QBOX_IPC_STATUS_FAILED);
+        }
+    }
+    for (const QString &command : std::as_const(spawns))
+        QProcess::startDetached("/bin/sh", {"-c", command});
+
+    queueMessage(client, QBOX_IPC_MSG_REPLY, status);
+}
+
+void QBoxIpc::broadcastEvent(uint32_t type, uint32_t id, const QByteArray &data)
+{
+    qbox_ipc_event event { type, id, uint32_t(data.size()) };
+    QByteArray payload(reinterpret_cast<const char*>(&event), sizeof(event));
+    payload.append(data);
+
+    for (Client *client : std::as_const(m_clients)) {
+        if (client->dead || !(client->eventMask & type))
+            continue;
+        if (client->out.size() + payload.size() > EventBufferLimit) {
+            ++client->droppedEvents;
+            continue;
+        }
+        /* Only write directly when nothing is queued, otherwise the write
+         * notifier is already armed and will pick this event up. */
+        const bool idle = client->out.isEmpty();
+        queueMessage(client, QBOX_IPC_MSG_EVENT, payload);
+        /* Events are sent from deep inside request handling, possibly for
+         * this very client, so it can't be freed here. */
+        if (idle && !flush(client))
+            markDead(client);
+    }
+}
+
+bool QBoxIpc::queueMessage(Client *client, uint16_t type, const QByteArray &payload)
+{
+    qbox_ipc_header header { uint32_t(payload.size()), type, 0 };
+    client->out.append(reinterpret_cast<const char*>(&header), sizeof(header));
+    client->out.append(payload);
+    return client->out.size() <= ReplyBufferLimit;
+}
+
+bool QBoxIpc::flush(Client *client)
+{
+    while (!client->out.isEmpty()) {
+        ssize_t n = send(client->fd, client->out.constData(), client->out.size(), MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                client->writeNotifier->setEnabled(true);
+                return true;
+            }
+            return false;
+        }
+        client->out.remove(0, n);
+
+        /* Tell the subscriber what it missed once it has caught up. */
+        if (client->out.isEmpty() && client->droppedEvents) {
+            const uint32_t dropped = client->droppedEvents;
+            client->droppedEvents = 0;
+            queueMessage(client, QBOX_IPC_MSG_EVENTS_DROPPED,
+                         QByteArray(reinterpret_cast<const char*>(&dropped), sizeof(dropped)));
+        }
+    }
+    client->writeNotifier->setEnabled(false);
+    return true;
+}
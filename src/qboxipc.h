@@ -0,0 +1,68 @@
+#ifndef QBOXIPC_H
+#define QBOXIPC_H
+
+#include "qboxoutput.h"
+#include "qboxipcprotocol.h"
+
+#include <QObject>
+#include <QByteArray>
+#include <QList>
+
+QT_BEGIN_NAMESPACE
+class QSocketNotifier;
+QT_END_NAMESPACE
+
+class QBoxServer;
+
+class QBoxIpc : public QObject
+{
+    Q_OBJECT
+    using View = QBoxOutPut::View;
+
+public:
+    explicit QBoxIpc(QBoxServer *server);
+    ~QBoxIpc();
+
+    bool start(const QByteArray &path);
+    QByteArray socketPath() const {
+        return m_path;
+    }
+
+private:
+    struct Client
+    {
+        int fd = -1;
+        QSocketNotifier *readNotifier = nullptr;
+        QSocketNotifier *writeNotifier = nullptr;
+        QByteArray in;
+        QByteArray out;
+        uint32_t eventMask = 0;
+        uint32_t droppedEvents = 0;
+        /* Failed while something further up the stack may still use it,
+         * freed by reapClients(). */
+        bool dead = false;
+    };
+
+    void onNewConnection();
+    void onClientReadable(Client *client);
+    void onClientWritable(Client *client);
+    void destroyClient(Client *client);
+    void markDead(Client *client);
+    void reapClients();
+
+    bool handleMessage(Client *client, uint16_t type, const char *data, uint32_t length);
+    void handleBatch(Client *client, const char *data, uint32_t length);
+    void broadcastEvent(uint32_t type, uint32_t id, const QByteArray &data);
+    bool queueMessage(Client *client, uint16_t type, const QByteArray &payload);
+    bool flush(Client *client);
+
+    int m_fd = -1;
+    QSocketNotifier *m_listenNotifier = nullptr;
+    QList<Client*> m_clients;
+    bool m_reapPending = false;
+    QByteArray m_path;
+
+    QBoxServer *m_server;
+};
+
+#endif // QBOXIPC_H
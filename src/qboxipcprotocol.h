@@ -0,0 +1,79 @@
+#ifndef QBOXIPCPROTOCOL_H
+#define QBOXIPCPROTOCOL_H
+
+/* Wire format of the qwlbox control socket ($QWLBOX_SOCKET).
+ *
+ * Every message starts with a qbox_ipc_header followed by `length` bytes of
+ * payload. The socket is local only, so all integers are in host byte order.
+ * This header is plain C so that clients can include it as-is. */
+
+#include <stdint.h>
+
+#define QBOX_IPC_MAX_MESSAGE_LENGTH (64 * 1024)
+
+struct qbox_ipc_header {
+    uint32_t length;
+    uint16_t type;
+    uint16_t flags;
+};
+
+enum qbox_ipc_message_type {
+    /* client -> server */
+    QBOX_IPC_MSG_BATCH = 1,          /* a run of qbox_ipc_command, applied atomically */
+    QBOX_IPC_MSG_SUBSCRIBE = 2,      /* uint32_t mask of qbox_ipc_event_type */
+    QBOX_IPC_MSG_GET_STATS = 3,      /* no payload */
+    QBOX_IPC_MSG_GET_MEMORY = 4,     /* no payload */
+
+    /* server -> client */
+    QBOX_IPC_MSG_REPLY = 0x100,      /* uint8_t status per command of the batch */
+    QBOX_IPC_MSG_EVENT = 0x101,      /* qbox_ipc_event followed by its data */
+    QBOX_IPC_MSG_EVENTS_DROPPED = 0x102, /* uint32_t number of events dropped */
+    QBOX_IPC_MSG_STATS = 0x103,      /* "key=value\n" lines, UTF-8 */
+    QBOX_IPC_MSG_MEMORY = 0x104,     /* "key=value\n" lines, sizes in bytes */
+};
+
+/* A batch is a sequence of commands, each followed by `length` bytes of
+ * arguments. View ids are the ones reported by QBOX_IPC_EVENT_MAP. */
+struct qbox_ipc_command {
+    uint16_t op;
+    uint16_t length;
+};
+
+enum qbox_ipc_command_op {
+    QBOX_IPC_OP_FOCUS = 1,      /* uint32_t view */
+    QBOX_IPC_OP_MOVE = 2,       /* uint32_t view, int32_t x, int32_t y */
+    QBOX_IPC_OP_RESIZE = 3,     /* uint32_t view, int32_t width, int32_t height */
+    QBOX_IPC_OP_WORKSPACE = 4,  /* uint32_t workspace */
+    QBOX_IPC_OP_SPAWN = 5,      /* command line, not NUL terminated */
+    QBOX_IPC_OP_CLOSE = 6,      /* uint32_t view */
+    QBOX_IPC_OP_OUTPUT_CREATE = 7,  /* int32_t width, int32_t height, int32_t refresh (mHz, 0: default);
+                                     * the name is reported by QBOX_IPC_EVENT_OUTPUT_ADD */
+    QBOX_IPC_OP_OUTPUT_DESTROY = 8, /* output name of a virtual output, not NUL terminated */
+};
+
+enum qbox_ipc_status {
+    QBOX_IPC_STATUS_OK = 0,
+    QBOX_IPC_STATUS_ABORTED = 1,     /* another command of the batch failed */
+    QBOX_IPC_STATUS_UNKNOWN_OP = 2,
+    QBOX_IPC_STATUS_BAD_ARGS = 3,
+    QBOX_IPC_STATUS_UNKNOWN_VIEW = 4,
+    QBOX_IPC_STATUS_UNSUPPORTED = 5,
+    QBOX_IPC_STATUS_UNKNOWN_OUTPUT = 6,
+    QBOX_IPC_STATUS_FAILED = 7,      /* valid, but carrying it out failed */
+};
+
+enum qbox_ipc_event_type {
+    QBOX_IPC_EVENT_MAP = 1 << 0,           /* id: view, data: app_id */
+    QBOX_IPC_EVENT_UNMAP = 1 << 1,         /* id: view, data: app_id */
+    QBOX_IPC_EVENT_FOCUS = 1 << 2,         /* id: view, data: app_id */
+    QBOX_IPC_EVENT_OUTPUT_ADD = 1 << 3,    /* id: 0, data: output name */
+    QBOX_IPC_EVENT_OUTPUT_REMOVE = 1 << 4, /* id: 0, data: output name */
+};
+
+struct qbox_ipc_event {
+    uint32_t type;
+    uint32_t id;
+    uint32_t length;
+};
+
+#endif // QBOXIPCPROTOCOL_H
@@ -0,0 +1,277 @@
+#include "qboxkeybindings.h"
+#include "qboxserver.h"
+
+#include <QFile>
+#include <QGuiApplication>
+#include <QProcess>
+
+/* Lock modifiers never take part in matching. */
+static constexpr uint32_t IgnoredModifiers = WLR_MODIFIER_CAPS | WLR_MODIFIER_MOD2;
+
+/* Used when the user has no keybindings file, same as the old hard-coded
+ * bindings. */
+static const char DefaultBindings[] =
+    "[default]\n"
+    "Alt+Escape = exit\n"
+    "Ctrl+Escape = exit\n"
+    "Alt+F1 = focus-next\n"
+    "Ctrl+F1 = focus-next\n"
+    "Alt+Tab = switch-next\n"
+    "Alt+Shift+Tab = switch-previous\n";
+
+QBoxKeybindings::QBoxKeybindings(QBoxServer *server):
+    m_server(server),
+    QObject(server)
+{
+    if (!load())
+        loadFromData(DefaultBindings, QStringLiteral("<default>"));
+
+    connect(server->config, &QBoxConfig::keybindingsChanged, this, [this] {
+        if (load())
+            return;
+        if (QFile::exists(m_server->config->keybindingsPath()))
+            qWarning("keybindings not reloaded, keeping the current ones");
+        else
+            loadFromData(DefaultBindings, QStringLiteral("<default>"));
+    });
+}
+
+bool QBoxKeybindings::load()
+{
+    QFile file(m_server->config->keybindingsPath());
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+    return loadFromData(file.readAll(), file.fileName());
+}
+
+bool QBoxKeybindings::loadFromData(const QByteArray &data, const QString &origin)
+{
+    /* The whole file is compiled into a new table and only swapped in when
+     * it has no errors, a broken edit keeps the previous bindings alive. */
+    auto table = QSharedPointer<Table>::create();
+    int root = -1;
+
+    auto modeRoot = [&table](const QString &mode) {
+        auto it = table->modes.constFind(mode);
+        if (it != table->modes.cend())
+            return *it;
+        table->nodes.append(Node());
+        table->modes.insert(mode, table->nodes.size() - 1);
+        return int(table->nodes.size() - 1);
+    };
+    root = modeRoot(QStringLiteral("default"));
+
+    const QList<QByteArray> lines = data.split('\n');
+    for (int i = 0; i < lines.size(); ++i) {
+        const QString line = QString::fromUtf8(lines.at(i)).trimmed();
+        if (line.isEmpty() || line.startsWith(QLatin1Char('#')))
+            continue;
+
+        if (line.startsWith(QLatin1Char('[')) && line.endsWith(QLatin1Char(']'))) {
+            root = modeRoot(line.mid(1, line.size() - 2).trimmed());
+            continue;
+        }
+
+        const qsizetype equal = line.indexOf(QLatin1Char('='));
+        if (equal < 0) {
+            qWarning("%s:%d: expected \"keys = action\"", qPrintable(origin), i + 1);
+            return false;
+        }
+        const QStringList steps = line.left(equal).split(QLatin1Char(' '), Qt::SkipEmptyParts);
+        const QString command = line.mid(equal + 1).trimmed();
+        const QString actionName = command.section(QLatin1Char(' '), 0, 0);
+        const QString argument = command.section(QLatin1Char(' '), 1).trimmed();
+
+        static const QHash<QString, Action> actions {
+            { QStringLiteral("exit"), Action::Exit },
+            { QStringLiteral("focus-next"), Action::FocusNext },
+            { QStringLiteral("close"), Action::Close },
+            { QStringLiteral("spawn"), Action::Spawn },
+            { QStringLiteral("mode"), Action::Mode },
+            { QStringLiteral("reload"), Action::Reload },
+            { QStringLiteral("switch-next"), Action::SwitchNext },
+            { QStringLiteral("switch-previous"), Action::SwitchPrevious },
+        };
+        const Action action = actions.value(actionName, Action::None);
+        if (action == Action::None || steps.isEmpty()) {
+            qWarning("%s:%d: unknown action \"%s\"", qPrintable(origin), i + 1, qPrintable(actionName));
+            return false;
+        }
+        if ((action == Action::Spawn || action == Action::Mode) && argument.isEmpty()) {
+            qWarning("%s:%d: %s needs an argument", qPrintable(origin), i + 1, qPrintable(actionName));
+            return false;
+        }
+        if (action == Action::Mode)
+            modeRoot(argument);
+
+        int node = root;
+        for (int s = 0; s < steps.size(); ++s) {
+            quint64 k;
+            if (!parseStep(steps.at(s), &k)) {
+                qWarning("%s:%d: invalid key \"%s\"", qPrintable(origin), i + 1, qPrintable(steps.at(s)));
+                return false;
+            }
+            if (s == 0)
+                table->nodes[root].masks.set(k >> 32);
+
+            int next = table->nodes.at(node).next.value(k, -1);
+            if (next < 0) {
+                table->nodes.append(Node());
+                next = table->nodes.size() - 1;
+                table->nodes[node].next.insert(k, next);
+            }
+            if (s < steps.size() - 1 && table->nodes.at(next).action != Action::None) {
+                qWarning("%s:%d: \"%s\" is already bound", qPrintable(origin), i + 1, qPrintable(steps.at(s)));
+                return false;
+            }
+            node = next;
+        }
+
+        Node &target = table->nodes[node];
+        if (target.action != Action::None || !target.next.isEmpty()) {
+            qWarning("%s:%d: \"%s\" conflicts with another binding",
+                     qPrintable(origin), i + 1, qPrintable(line.left(equal).trimmed()));
+            return false;
+        }
+        target.action = action;
+        target.argument = argument;
+    }
+
+    m_table = table;
+    m_chord = -1;
+    setMode(m_table->modes.contains(m_mode) ? m_mode : QStringLiteral("default"));
+    return true;
+}
+
+bool QBoxKeybindings::parseStep(const QString &step, quint64 *result)
+{
+    static const QHash<QString, uint32_t> modifierNames {
+        { QStringLiteral("shift"), WLR_MODIFIER_SHIFT },
+        { QStringLiteral("ctrl"), WLR_MODIFIER_CTRL },
+        { QStringLiteral("control"), WLR_MODIFIER_CTRL },
+        { QStringLiteral("alt"), WLR_MODIFIER_ALT },
+        { QStringLiteral("mod1"), WLR_MODIFIER_ALT },
+        { QStringLiteral("mod3"), WLR_MODIFIER_MOD3 },
+        { QStringLiteral("super"), WLR_MODIFIER_LOGO },
+        { QStringLiteral("logo"), WLR_MODIFIER_LOGO },
+        { QStringLiteral("mod4"), WLR_MODIFIER_LOGO },
+        { QStringLiteral("mod5"), WLR_MODIFIER_MOD5 },
+    };
+
+    const QStringList parts = step.split(QLatin1Char('+'), Qt::SkipEmptyParts);
+    if (parts.isEmpty())
+        return false;
+
+    uint32_t modifiers = 0;
+    for (int i = 0; i < parts.size() - 1; ++i) {
+        auto it = modifierNames.constFind(parts.at(i).toLower());
+        if (it == modifierNames.cend())
+            return false;
+        modifiers |= *it;
+    }
+
+    const QByteArray name = parts.last().toUtf8();
+    xkb_keysym_t sym = xkb_keysym_from_name(name.constData(), XKB_KEYSYM_CASE_INSENSITIVE);
+    if (sym == XKB_KEY_NoSymbol)
+        return false;
+
+    *result = key(modifiers, sym);
+    return true;
+}
+
+bool QBoxKeybindings::handleKey(xkb_state *state, uint32_t keycode, uint32_t modifiers)
+{
+    modifiers &= ~IgnoredModifiers;
+    const Table &table = *m_table;
+
+    /* Fast path: outside of a chord, a key can only be bound if some binding
+     * of the current mode uses exactly these modifiers. */
+    if (m_chord < 0 && !table.nodes.at(m_root).masks.test(modifiers))
+        return false;
+
+    const xkb_keysym_t *syms;
+    int nsyms = xkb_state_key_get_syms(state, keycode, &syms);
+    /* Shift changes the keysym itself (Shift+Tab is ISO_Left_Tab, Shift+1
+     * is exclam), so Shift+Tab and Super+Shift+1 are matched on the keysym
+     * of the first shift level, with all modifiers kept. */
+    const xkb_keysym_t *rawSyms;
+    const int nrawSyms = xkb_keymap_key_get_syms_by_level(xkb_state_get_keymap(state), keycode,
+                                                          xkb_state_key_get_layout(state, keycode),
+                                                          0, &rawSyms);
+
+    const int current = m_chord >= 0 ? m_chord : m_root;
+    const QHash<quint64, int> &candidates = table.nodes.at(current).next;
+    int next = -1;
+    for (int i = 0; i < nsyms && next < 0; i++)
+        next = candidates.value(key(modifiers, syms[i]), -1);
+    for (int i = 0; i < nrawSyms && next < 0; i++)
+        next = candidates.value(key(modifiers, rawSyms[i]), -1);
+
+    if (next >= 0) {
+        const Node &node = table.nodes.at(next);
+        if (!node.next.isEmpty()) {
+            m_chord = next;
+            return true;
+        }
+        m_chord = -1;
+        /* Keep the table alive, the action may reload it. */
+        QSharedPointer<const Table> guard = m_table;
+        run(node);
+        return true;
+    }
+
+    /* Pressing the modifiers of the next chord step must not cancel it. */
+    for (int i = 0; i < nsyms; i++) {
+        if (syms[i] >= XKB_KEY_Shift_L && syms[i] <= XKB_KEY_Hyper_R)
+            return false;
+    }
+    m_chord = -1;
+    return false;
+}
+
+void QBoxKeybindings::run(const Node &node)
+{
+    auto &views = m_server->views;
+    switch (node.action) {
+    case Action::Exit:
+        m_server->display->terminate();
+        qApp->exit();
+        break;
+    case Action::FocusNext:
+        if (views.size() < 2)
+            break;
+        m_server->xdgShell->focusView(views.at(1), views.at(1)->surface());
+        break;
+    case Action::Close:
+        if (!views.isEmpty())
+            views.first()->close();
+        break;
+    case Action::Spawn:
+        QProcess::startDetached("/bin/sh", {"-c", node.argument});
+        break;
+    case Action::Mode:
+        setMode(node.argument);
+        break;
+    case Action::Reload:
+        if (!load())
+            qWarning("keybindings not reloaded, keeping the current ones");
+        break;
+    case Action::SwitchNext:
+        m_server->switcher->step(1);
+        break;
+    case Action::SwitchPrevious:
+        m_server->switcher->step(-1);
+        break;
+    case Action::None:
+        break;
+    }
+}
+
+void QBoxKeybindings::setMode(const QString &mode)
+{
+    auto it = m_table->modes.constFind(mode);
+    Q_ASSERT(it != m_table->modes.cend());
+    m_mode = mode;
+    m_root = *it;
+    m_chord = -1;
+}
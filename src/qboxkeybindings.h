@@ -0,0 +1,74 @@
+#ifndef QBOXKEYBINDINGS_H
+#define QBOXKEYBINDINGS_H
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QSharedPointer>
+#include <QString>
+
+#include <bitset>
+
+extern "C" {
+#include <xkbcommon/xkbcommon.h>
+}
+
+class QBoxServer;
+
+class QBoxKeybindings : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QBoxKeybindings(QBoxServer *server);
+
+    enum class Action {
+        None,
+        Exit,
+        FocusNext,
+        Close,
+        Spawn,
+        Mode,
+        Reload,
+        SwitchNext,
+        SwitchPrevious,
+    };
+
+    bool load();
+    bool loadFromData(const QByteArray &data, const QString &origin);
+
+    bool handleKey(xkb_state *state, uint32_t keycode, uint32_t modifiers);
+
+private:
+    struct Node
+    {
+        /* Keyed on (modifier mask << 32 | keysym), value is a node index. */
+        QHash<quint64, int> next;
+        Action action = Action::None;
+        QString argument;
+        /* Only used by mode roots: every modifier mask that starts a
+         * binding, so unbound keys can skip the keysym lookup. */
+        std::bitset<256> masks;
+    };
+
+    struct Table
+    {
+        QList<Node> nodes;
+        QHash<QString, int> modes;
+    };
+
+    static quint64 key(uint32_t modifiers, xkb_keysym_t sym) {
+        return (quint64(modifiers) << 32) | xkb_keysym_to_lower(sym);
+    }
+    static bool parseStep(const QString &step, quint64 *result);
+    void run(const Node &node);
+    void setMode(const QString &mode);
+
+    QSharedPointer<const Table> m_table;
+    QString m_mode;
+    int m_root = -1;
+    int m_chord = -1;
+
+    QBoxServer *m_server;
+};
+
+#endif // QBOXKEYBINDINGS_H
@@ -1,5 +1,23 @@
 #include "qboxoutput.h"
 #include "qboxserver.h"
+#include "qwconfig.h"
+
+#include <QTimer>
+
+#include <algorithm>
+
+extern "C" {
+#include <wlr/backend/headless.h>
+#include <wlr/backend/multi.h>
+#include <wlr/types/wlr_export_dmabuf_v1.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_output_management_v1.h>
+#include <wlr/types/wlr_screencopy_v1.h>
+#if WLR_VERSION_MINOR > 16
+#include <wlr/types/wlr_content_type_v1.h>
+#include <wlr/types/wlr_tearing_control_v1.h>
+#endif
+}
 
 QBoxOutPut::QBoxOutPut(QBoxServer *server):
     m_server(server),
@@ -7,34 +25,689 @@ QBoxOutPut::QBoxOutPut(QBoxServer *server):
 {
     outputLayout = new QWOutputLayout(this);
     connect(m_server->backend, &QWBackend::newOutput, this, &QBoxOutPut::onNewOutput);
+    connect(m_server->config, &QBoxConfig::outputChanged, this, &QBoxOutPut::onOutputConfigChanged);
+    /* Also emitted when an output changes mode, scale or transform. */
+    m_sc.connect(&outputLayout->handle()->events.change, this, &QBoxOutPut::onLayoutChange);
+
+    /* Screen capture, for streaming virtual outputs as much as for
+     * screenshots. A capture request schedules a frame itself, so it works
+     * with outputs that otherwise sit idle. */
+    wlr_screencopy_manager_v1_create(server->display->handle());
+    wlr_export_dmabuf_manager_v1_create(server->display->handle());
+
+#if WLR_VERSION_MINOR > 16
+    /* Lets games and video players tell us they benefit from VRR. */
+    m_contentTypeManager = wlr_content_type_manager_v1_create(server->display->handle(), 1);
+    /* And fullscreen clients that they would rather tear than wait. */
+    m_tearingControlManager = wlr_tearing_control_manager_v1_create(server->display->handle(), 1);
+#endif
+
+    /* For virtual outputs. Added before the backend starts, which starts it
+     * along: wlr_multi_backend_add() doesn't start what it is given. */
+    wlr_backend *backend = m_server->backend->handle();
+    /* wlr_backend_autocreate() always returns a multi backend. */
+    if (wlr_backend_is_multi(backend)) {
+#if WLR_VERSION_MINOR > 17
+        wlr_backend *headless = wlr_headless_backend_create(wl_display_get_event_loop(server->display->handle()));
+#else
+        wlr_backend *headless = wlr_headless_backend_create(server->display->handle());
+#endif
+        if (headless && !wlr_multi_backend_add(backend, headless)) {
+            wlr_backend_destroy(headless);
+            headless = nullptr;
+        }
+        m_headlessBackend = headless;
+    }
+}
+
+void QBoxOutPut::setSimulatedAdaptiveSync(int minRefresh, int maxRefresh)
+{
+    /* For headless runs: outputs refresh at maxRefresh and adaptive sync is
+     * only toggled in OutputState, never committed. The scheduler then caps
+     * presentation at maxRefresh on the real clock and logs the frame rate
+     * it achieves. minRefresh is only reported: a panel's own timing, e.g.
+     * frame doubling below it, is not emulated. */
+    m_simulatedAdaptiveSync = true;
+    m_simulatedMinRefresh = minRefresh;
+    m_simulatedMaxRefresh = maxRefresh;
 }
 
 void QBoxOutPut::onNewOutput(QWOutput *output)
 {
     Q_ASSERT(output);
     outputs.append(output);
+    auto *state = new OutputState(output->handle()->name);
+    state->renderTimer = new QTimer(this);
+    state->renderTimer->setSingleShot(true);
+    state->renderTimer->setTimerType(Qt::PreciseTimer);
+    connect(state->renderTimer, &QTimer::timeout, this, [this, output] {
+        renderOutput(output);
+    });
+    if (m_simulatedAdaptiveSync) {
+        state->scheduler.setRefreshRange(m_simulatedMinRefresh, m_simulatedMaxRefresh);
+        state->scheduler.setStatisticsInterval(1000000000);
+    }
+    if (m_pendingVirtualSize.isValid()) {
+        state->virtualSize = m_pendingVirtualSize;
+        state->virtualRefresh = m_pendingVirtualRefresh;
+        m_pendingVirtualSize = QSize();
+        m_virtualOutputs.append(output);
+    }
+    m_states.insert(output, state);
+    connect(output, &QObject::destroyed, this, [this, output] {
+        outputs.removeOne(output);
+        m_virtualOutputs.removeOne(output);
+        OutputState *state = m_states.take(output);
+        delete state->renderTimer;
+        delete state;
+    });
 
     output->initRender(m_server->allocator, m_server->renderer);
-    if (!wl_list_empty(&output->handle()->modes)) {
-        auto *mode = output->preferredMode();
-        output->setMode(mode);
-    }
-    output->enable(true);
-    if (!output->commit())
-        return;
+    auto config = m_server->config->current();
+    /* Still tracked, a config reload or a power up may get it going. */
+    if (!configureOutput(output, config->outputs.value(output->handle()->name)))
+        qWarning("failed to configure output %s", output->handle()->name);
 
     connect(output, &QWOutput::frame, this, &QBoxOutPut::onOutputFrame);
-    outputLayout->addAuto(output);
+    connect(output, &QWOutput::present, this, &QBoxOutPut::onOutputPresent);
+    updateAdaptiveSync(output);
+
+    Q_EMIT outputAdded(output);
+}
+
+void QBoxOutPut::onLayoutChange()
+{
+    for (QWOutput *output : std::as_const(outputs)) {
+        OutputState *state = m_states.value(output);
+        wlr_box box {};
+        wlr_output_layout_get_box(outputLayout->handle(), output->handle(), &box);
+        state->layoutBox = QRect(box.x, box.y, box.width, box.height);
+        /* Nothing reserves space yet, layer surfaces don't have exclusive
+         * zones. */
+        state->usableArea = state->layoutBox;
+        state->scale = output->handle()->scale;
+    }
+    Q_EMIT layoutChanged();
+}
+
+QWOutput *QBoxOutPut::outputAt(const QPointF &pos) const
+{
+    QWOutput *closest = nullptr;
+    qreal closestDistance = 0;
+    for (QWOutput *output : std::as_const(outputs)) {
+        const QRectF box = m_states.value(output)->layoutBox;
+        if (box.isEmpty())
+            continue;
+        if (box.contains(pos))
+            return output;
+        const qreal dx = qMax(0.0, qMax(box.left() - pos.x(), pos.x() - box.right()));
+        const qreal dy = qMax(0.0, qMax(box.top() - pos.y(), pos.y() - box.bottom()));
+        const qreal distance = dx * dx + dy * dy;
+        if (!closest || distance < closestDistance) {
+            closest = output;
+            closestDistance = distance;
+        }
+    }
+    return closest;
+}
+
+QRect QBoxOutPut::layoutBox(QWOutput *output) const
+{
+    const OutputState *state = m_states.value(output);
+    return state ? state->layoutBox : QRect();
+}
+
+QRect QBoxOutPut::usableArea(QWOutput *output) const
+{
+    const OutputState *state = m_states.value(output);
+    return state ? state->usableArea : QRect();
+}
+
+float QBoxOutPut::scale(QWOutput *output) const
+{
+    const OutputState *state = m_states.value(output);
+    return state ? state->scale : 1.0f;
 }
 
 void QBoxOutPut::onOutputFrame()
 {
     auto output = qobject_cast<QWOutput*>(sender());
     Q_ASSERT(output);
+    renderOutput(output);
+}
+
+void QBoxOutPut::renderOutput(QWOutput *output, bool tearing)
+{
+    /* The frame event that follows the pending page flip will pick up
+     * whatever changed in the meantime. */
+    if (!output->handle()->enabled || output->handle()->frame_pending)
+        return;
+
     auto sceneOutput = QWSceneOutput::from(m_server->xdgShell->getScene(), output);
+#if WLR_VERSION_MINOR > 16
+    if (tearing) {
+        wlr_output_state state;
+        wlr_output_state_init(&state);
+        if (wlr_scene_output_build_state(sceneOutput->handle(), &state, nullptr)) {
+            state.tearing_page_flip = true;
+            if (!wlr_output_test_state(output->handle(), &state)) {
+                /* Not every driver can flip asynchronously, fall back to vsync. */
+                if (OutputState *outputState = m_states.value(output))
+                    ++outputState->asyncRejected;
+                state.tearing_page_flip = false;
+            }
+            /* Counted from what was committed: the present event doesn't
+             * tell an async flip from a display without vsync. */
+            if (wlr_output_commit_state(output->handle(), &state) && state.tearing_page_flip) {
+                if (OutputState *outputState = m_states.value(output)) {
+                    ++outputState->asyncFlips;
+                    outputState->asyncFlipPending = true;
+                }
+            }
+        }
+        wlr_output_state_finish(&state);
+    } else {
+        sceneOutput->commit(nullptr);
+    }
+#else
+    Q_UNUSED(tearing);
     sceneOutput->commit(nullptr);
+#endif
+
+    if (m_firstFrame) {
+        m_firstFrame = false;
+        m_server->startupPhase("first frame");
+    }
 
     struct timespec now;
     clock_gettime(CLOCK_MONOTONIC, &now);
-    sceneOutput->sendFrameDone(&now);
+    /* Come back for frame callbacks held back from throttled clients. */
+    const qint64 retry = m_server->clients->sendFrameDone(sceneOutput, &now);
+    OutputState *state = m_states.value(output);
+    if (retry > 0 && state && !state->renderTimer->isActive())
+        state->renderTimer->start(int((retry + 999999) / 1000000));
+}
+
+void QBoxOutPut::onOutputPresent(wlr_output_event_present *event)
+{
+    OutputState *state = m_states.value(qobject_cast<QWOutput*>(sender()));
+    if (!state)
+        return;
+    /* Every commit gets exactly one present event, presented or not. */
+    const bool async = state->asyncFlipPending;
+    state->asyncFlipPending = false;
+    if (!event->presented)
+        return;
+    state->scheduler.presented();
+    if (!async)
+        ++state->vsyncFlips;
+}
+
+void QBoxOutPut::onFocusedViewCommitted(View *view)
+{
+    QWOutput *output = m_server->xdgShell->getActiveOutput(view);
+    OutputState *state = m_states.value(output);
+    if (!state)
+        return;
+
+    /* A fullscreen client that asked for async presentation gets every
+     * frame on screen right away, torn or not. */
+    if (wantsTearing(output, view)) {
+        renderOutput(output, true);
+        return;
+    }
+
+    /* The content type is double-buffered surface state, so a commit is
+     * where it can change. */
+    updateAdaptiveSync(output);
+    if (!state->adaptiveSync || state->renderTimer->isActive())
+        return;
+
+    /* With VRR the refresh follows this client: present its frame as soon
+     * as it is committed instead of waiting for the next frame event. */
+    const qint64 delay = state->scheduler.contentCommitted();
+    if (delay > 0)
+        state->renderTimer->start(int((delay + 999999) / 1000000));
+    else
+        renderOutput(output);
+}
+
+bool QBoxOutPut::wantsTearing(QWOutput *output, View *view) const
+{
+#if WLR_VERSION_MINOR > 16
+    if (!view->fullscreen)
+        return false;
+    auto config = m_server->config->current();
+    if (!config->outputs.value(output->handle()->name).allowTearing)
+        return false;
+    auto hint = wlr_tearing_control_manager_v1_surface_hint_from_surface(
+                m_tearingControlManager, view->surface());
+    return hint == WP_TEARING_CONTROL_V1_PRESENTATION_HINT_ASYNC;
+#else
+    Q_UNUSED(output);
+    Q_UNUSED(view);
+    return false;
+#endif
+}
+
+void QBoxOutPut::appendStatistics(QByteArray *out) const
+{
+    for (QWOutput *output : std::as_const(outputs)) {
+        const OutputState *state = m_states.value(output);
+        if (!state)
+            continue;
+        const QByteArray prefix = QByteArray("output.") + output->handle()->name;
+        *out += prefix + ".adaptive_sync=" + QByteArray::number(state->adaptiveSync) + '\n';
+        *out += prefix + ".flips.vsync=" + QByteArray::number(state->vsyncFlips) + '\n';
+        *out += prefix + ".flips.async=" + QByteArray::number(state->asyncFlips) + '\n';
+        *out += prefix + ".flips.async_rejected=" + QByteArray::number(state->asyncRejected) + '\n';
+    }
+}
+
+void QBoxOutPut::onViewStateChanged()
+{
+    for (QWOutput *output : std::as_const(outputs))
+        updateAdaptiveSync(output);
+}
+
+bool QBoxOutPut::wantsAdaptiveSync(QWOutput *output) const
+{
+    const auto &views = m_server->views;
+    if (views.isEmpty())
+        return false;
+    View *view = views.first();
+    if (m_server->xdgShell->getActiveOutput(view) != output)
+        return false;
+
+    if (view->fullscreen)
+        return true;
+#if WLR_VERSION_MINOR > 16
+    auto type = wlr_surface_get_content_type_v1(m_contentTypeManager, view->surface());
+    return type == WP_CONTENT_TYPE_V1_TYPE_GAME || type == WP_CONTENT_TYPE_V1_TYPE_VIDEO;
+#else
+    return false;
+#endif
+}
+
+void QBoxOutPut::updateAdaptiveSync(QWOutput *output)
+{
+    OutputState *state = m_states.value(output);
+    wlr_output *handle = output->handle();
+    if (!state || !handle->enabled || state->adaptiveSyncUnsupported)
+        return;
+
+    auto config = m_server->config->current();
+    bool enable = false;
+    switch (config->outputs.value(handle->name).adaptiveSync) {
+    case QBoxConfig::AdaptiveSync::Off:
+        break;
+    case QBoxConfig::AdaptiveSync::On:
+        enable = true;
+        break;
+    case QBoxConfig::AdaptiveSync::Auto:
+        enable = state->adaptiveSyncChosen ? state->adaptiveSyncChoice : wantsAdaptiveSync(output);
+        break;
+    }
+
+    if (!m_simulatedAdaptiveSync) {
+        const bool enabled = handle->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED;
+        if (enable != enabled) {
+            wlr_output_enable_adaptive_sync(handle, enable);
+            if (!wlr_output_test(handle)) {
+                wlr_output_rollback(handle);
+                if (enable) {
+                    qInfo("adaptive sync is not supported by %s", handle->name);
+                    state->adaptiveSyncUnsupported = true;
+                }
+                return;
+            }
+            /* Accepted but failed, e.g. in the middle of a modeset: the next
+             * update tries again. */
+            if (!wlr_output_commit(handle)) {
+                wlr_output_rollback(handle);
+                return;
+            }
+        }
+        state->scheduler.setRefreshRange(0, handle->refresh);
+    }
+
+    if (state->adaptiveSync != enable) {
+        state->adaptiveSync = enable;
+        state->renderTimer->stop();
+    }
+}
+
+void QBoxOutPut::onOutputConfigChanged(const QString &name)
+{
+    /* Only the output whose section changed is touched. */
+    for (QWOutput *output : std::as_const(outputs)) {
+        if (name != QLatin1String(output->handle()->name))
+            continue;
+        OutputState *state = m_states.value(output);
+        state->adaptiveSyncChosen = false;
+        /* Picked up when it is powered up again. */
+        if (!state->powered)
+            return;
+        auto config = m_server->config->current();
+        if (!configureOutput(output, config->outputs.value(name)))
+            qWarning("failed to apply the configuration of output %s", qPrintable(name));
+        updateAdaptiveSync(output);
+        return;
+    }
+}
+
+bool QBoxOutPut::configureOutput(QWOutput *output, const QBoxConfig::Output &config)
+{
+    wlr_output *handle = output->handle();
+    wlr_output_mode *mode = nullptr;
+    output->enable(config.enabled);
+    if (config.enabled) {
+        if (config.mode.isValid()) {
+            wlr_output_mode *m;
+            wl_list_for_each(m, &handle->modes, link) {
+                if (m->width == config.mode.width() && m->height == config.mode.height()
+                        && (!config.refresh || qAbs(m->refresh - config.refresh) < 500)) {
+                    mode = m;
+                    break;
+                }
+            }
+            if (!mode) {
+                wlr_output_set_custom_mode(handle, config.mode.width(), config.mode.height(), config.refresh);
+            }
+        } else if (!wl_list_empty(&handle->modes)) {
+            mode = output->preferredMode();
+        } else if (const OutputState *state = m_states.value(output); state && state->virtualSize.isValid()) {
+            wlr_output_set_custom_mode(handle, state->virtualSize.width(), state->virtualSize.height(),
+                                       state->virtualRefresh);
+        } else if (m_simulatedAdaptiveSync) {
+            /* Headless outputs have no modes, refresh them at the top of the
+             * simulated range so page flips never hold the scheduler back. */
+            wlr_output_set_custom_mode(handle, handle->width, handle->height, m_simulatedMaxRefresh);
+        }
+        if (mode)
+            output->setMode(mode);
+        wlr_output_set_scale(handle, config.scale);
+        wlr_output_set_transform(handle, config.transform);
+    }
+
+    if (!output->commit()) {
+        wlr_output_rollback(handle);
+        /* Most drivers reject a custom mode, a mode that isn't in the list
+         * is more likely a typo than a panel that takes it. Don't leave
+         * the output dark over it. */
+        const bool customMode = config.enabled && config.mode.isValid() && !mode;
+        if (!customMode || wl_list_empty(&handle->modes))
+            return false;
+        qWarning("output %s rejected mode %dx%d, using its preferred mode", handle->name,
+                 config.mode.width(), config.mode.height());
+        output->enable(true);
+        output->setMode(output->preferredMode());
+        wlr_output_set_scale(handle, config.scale);
+        wlr_output_set_transform(handle, config.transform);
+        if (!output->commit()) {
+            wlr_output_rollback(handle);
+            return false;
+        }
+    }
+
+    if (!config.enabled)
+        wlr_output_layout_remove(outputLayout->handle(), handle);
+    else if (config.hasPosition)
+        wlr_output_layout_add(outputLayout->handle(), handle, config.position.x(), config.position.y());
+    else if (!wlr_output_layout_get(outputLayout->handle(), handle))
+        outputLayout->addAuto(output);
+    return true;
+}
+
+bool QBoxOutPut::canCreateVirtualOutputs() const
+{
+    return m_headlessBackend;
+}
+
+QWOutput *QBoxOutPut::createVirtualOutput(const QSize &size, int refresh)
+{
+    if (size.isEmpty() || refresh < 0 || !canCreateVirtualOutputs())
+        return nullptr;
+    m_pendingVirtualSize = size;
+    m_pendingVirtualRefresh = refresh;
+    wlr_output *handle = wlr_headless_add_output(m_headlessBackend, size.width(), size.height());
+    m_pendingVirtualSize = QSize();
+    if (!handle)
+        return nullptr;
+    QWOutput *output = QWOutput::from(handle);
+    if (!m_virtualOutputs.contains(output)) {
+        /* Announced on start instead, before the backend ran. */
+        qWarning("virtual output %s was created before the backend started", handle->name);
+        wlr_output_destroy(handle);
+        return nullptr;
+    }
+    return output;
+}
+
+bool QBoxOutPut::isVirtualOutput(const QString &name) const
+{
+    for (QWOutput *output : std::as_const(m_virtualOutputs)) {
+        if (name == QLatin1String(output->handle()->name))
+            return true;
+    }
+    return false;
+}
+
+bool QBoxOutPut::destroyVirtualOutput(const QString &name)
+{
+    for (QWOutput *output : std::as_const(m_virtualOutputs)) {
+        if (name == QLatin1String(output->handle()->name)) {
+            /* The destroyed() handler of onNewOutput() does the rest. */
+            wlr_output_destroy(output->handle());
+            return true;
+        }
+    }
+    return false;
+}
+
+void QBoxOutPut::setPowered(QWOutput *output, bool on)
+{
+    OutputState *state = m_states.value(output);
+    if (!state || state->powered == on)
+        return;
+
+    if (on) {
+        /* Restores the mode too, and whatever changed in the config while
+         * the output was off. */
+        auto config = m_server->config->current();
+        if (!configureOutput(output, config->outputs.value(output->handle()->name))) {
+            qWarning("failed to power up output %s", output->handle()->name);
+            return;
+        }
+        state->powered = true;
+        state->poweredDownByIdle = false;
+        updateAdaptiveSync(output);
+        wlr_output_schedule_frame(output->handle());
+    } else {
+        state->renderTimer->stop();
+        output->enable(false);
+        if (!output->commit()) {
+            wlr_output_rollback(output->handle());
+            return;
+        }
+        state->powered = false;
+    }
+}
+
+void QBoxOutPut::setIdle(bool idle)
+{
+    for (QWOutput *output : std::as_const(outputs)) {
+        OutputState *state = m_states.value(output);
+        if (idle && state->powered && output->handle()->enabled) {
+            setPowered(output, false);
+            state->poweredDownByIdle = !state->powered;
+        } else if (!idle && state->poweredDownByIdle) {
+            setPowered(output, true);
+        }
+    }
+}
+
+bool QBoxOutPut::applyConfiguration(wlr_output_configuration_v1 *config, bool testOnly)
+{
+    /* Either every head takes its new state or none does: a layout that one
+     * output can't take is rejected as a whole instead of leaving the others
+     * half reconfigured. */
+    QList<wlr_output_configuration_head_v1*> heads;
+    wlr_output_configuration_head_v1 *head;
+    /* Adaptive sync goes through our policy: a change replaces auto, but
+     * can't override what the config forces. */
+    auto adaptiveSyncChanged = [](wlr_output_configuration_head_v1 *head) {
+        const bool enabled = head->state.output->adaptive_sync_status == WLR_OUTPUT_ADAPTIVE_SYNC_ENABLED;
+        return head->state.enabled && head->state.adaptive_sync_enabled != enabled;
+    };
+    auto outputConfig = m_server->config->current();
+    wl_list_for_each(head, &config->heads, link) {
+        const char *name = head->state.output->name;
+        if (adaptiveSyncChanged(head)
+                && outputConfig->outputs.value(name).adaptiveSync != QBoxConfig::AdaptiveSync::Auto) {
+            qWarning("adaptive sync of %s is set by the config", name);
+            return false;
+        }
+        heads.append(head);
+    }
+    /* Outputs being turned off go first so the CRTCs they free are available
+     * to the ones being turned on. */
+    std::stable_partition(heads.begin(), heads.end(), [](wlr_output_configuration_head_v1 *head) {
+        return !head->state.enabled;
+    });
+
+#if WLR_VERSION_MINOR > 17
+    /* A single modeset, so conflicts between outputs over CRTCs or bandwidth
+     * are tested as well. */
+    QList<wlr_backend_output_state> states(heads.size());
+    for (qsizetype i = 0; i < heads.size(); ++i) {
+        const wlr_output_head_v1_state &head = heads.at(i)->state;
+        states[i].output = head.output;
+        wlr_output_state_init(&states[i].base);
+        wlr_output_state_set_enabled(&states[i].base, head.enabled);
+        if (head.enabled) {
+            if (head.mode) {
+                wlr_output_state_set_mode(&states[i].base, head.mode);
+            } else {
+                wlr_output_state_set_custom_mode(&states[i].base, head.custom_mode.width,
+                                                 head.custom_mode.height, head.custom_mode.refresh);
+            }
+            wlr_output_state_set_scale(&states[i].base, head.scale);
+            wlr_output_state_set_transform(&states[i].base, head.transform);
+        }
+    }
+    wlr_backend *backend = m_server->backend->handle();
+    bool ok = wlr_backend_test(backend, states.data(), states.size());
+    if (!ok)
+        qWarning("output configuration rejected");
+    if (ok && !testOnly) {
+        ok = wlr_backend_commit(backend, states.data(), states.size());
+        if (!ok)
+            qWarning("failed to commit the output configuration");
+    }
+    for (wlr_backend_output_state &state : states)
+        wlr_output_state_finish(&state.base);
+    if (!ok || testOnly)
+        return ok;
+#else
+    /* What the outputs had before, to put back the ones already committed
+     * when a later one fails. */
+    struct Previous
+    {
+        bool enabled;
+        wlr_output_mode *mode;
+        int32_t width, height, refresh;
+        float scale;
+        wl_output_transform transform;
+    };
+    QList<Previous> previous;
+    for (auto *head : std::as_const(heads)) {
+        wlr_output *output = head->state.output;
+        previous.append({ output->enabled, output->current_mode, output->width, output->height,
+                          output->refresh, output->scale, output->transform });
+        wlr_output_enable(output, head->state.enabled);
+        if (head->state.enabled) {
+            if (head->state.mode) {
+                wlr_output_set_mode(output, head->state.mode);
+            } else {
+                wlr_output_set_custom_mode(output, head->state.custom_mode.width,
+                                           head->state.custom_mode.height,
+                                           head->state.custom_mode.refresh);
+            }
+            wlr_output_set_scale(output, head->state.scale);
+            wlr_output_set_transform(output, head->state.transform);
+        }
+    }
+
+    /* Only per output, this API can't test them together. */
+    bool ok = true;
+    for (auto *head : std::as_const(heads)) {
+        if (!wlr_output_test(head->state.output)) {
+            qWarning("output configuration rejected by %s", head->state.output->name);
+            ok = false;
+            break;
+        }
+    }
+    if (!ok || testOnly) {
+        for (auto *head : std::as_const(heads))
+            wlr_output_rollback(head->state.output);
+        return ok;
+    }
+
+    for (qsizetype i = 0; i < heads.size(); ++i) {
+        if (wlr_output_commit(heads.at(i)->state.output))
+            continue;
+        qWarning("failed to commit output %s", heads.at(i)->state.output->name);
+        for (qsizetype j = i; j < heads.size(); ++j)
+            wlr_output_rollback(heads.at(j)->state.output);
+        /* Backwards, so outputs turned off get their CRTCs back last. */
+        for (qsizetype j = i - 1; j >= 0; --j) {
+            wlr_output *output = heads.at(j)->state.output;
+            const Previous &old = previous.at(j);
+            wlr_output_enable(output, old.enabled);
+            if (old.enabled) {
+                if (old.mode)
+                    wlr_output_set_mode(output, old.mode);
+                else
+                    wlr_output_set_custom_mode(output, old.width, old.height, old.refresh);
+                wlr_output_set_scale(output, old.scale);
+                wlr_output_set_transform(output, old.transform);
+            }
+            if (!wlr_output_commit(output)) {
+                wlr_output_rollback(output);
+                qWarning("failed to restore output %s", output->name);
+            }
+        }
+        return false;
+    }
+#endif
+
+    auto *layout = outputLayout->handle();
+    for (auto *head : std::as_const(heads)) {
+        wlr_output *output = head->state.output;
+        if (head->state.enabled)
+            wlr_output_layout_add(layout, output, head->state.x, head->state.y);
+        else
+            wlr_output_layout_remove(layout, output);
+
+        /* The client decides now, idle must neither turn this output back
+         * on nor keep believing it is the one that turned it off. */
+        QWOutput *qwOutput = QWOutput::from(output);
+        OutputState *state = m_states.value(qwOutput);
+        if (!state)
+            continue;
+        state->powered = head->state.enabled;
+        state->poweredDownByIdle = false;
+        if (adaptiveSyncChanged(head)) {
+            state->adaptiveSyncChosen = true;
+            state->adaptiveSyncChoice = head->state.adaptive_sync_enabled;
+        }
+        if (state->powered) {
+            updateAdaptiveSync(qwOutput);
+            wlr_output_schedule_frame(output);
+        } else {
+            state->renderTimer->stop();
+        }
+    }
+    return true;
 }
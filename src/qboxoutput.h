@@ -5,7 +5,23 @@
 #include <qwxdgshell.h>
 #include <qwscene.h>
 #include <qwxdgdecorationmanagerv1.h>
+#include <qwsignalconnector.h>
 #include <QRect>
+#include <QHash>
+
+#include "qboxconfig.h"
+#include "qboxframescheduler.h"
+
+QT_BEGIN_NAMESPACE
+class QTimer;
+QT_END_NAMESPACE
+
+struct wlr_backend;
+struct wlr_content_type_manager_v1;
+struct wlr_tearing_control_manager_v1;
+struct wlr_output_event_present;
+struct wlr_output_configuration_v1;
+struct wlr_xwayland_surface;
 
 QW_USE_NAMESPACE
 
@@ -16,31 +32,143 @@ class QBoxOutPut : public QObject
     Q_OBJECT
     friend class QBoxCursor;
     friend class QBoxXdgShell;
+    friend class QBoxOutputManagement;
+    friend class QBoxSeat;
 public:
     explicit QBoxOutPut(QBoxServer *server);
     struct View
     {
         QBoxServer *server;
-        QWXdgToplevel *xdgToplevel;
+        uint32_t id;
+        QWXdgToplevel *xdgToplevel = nullptr;
+        /* Set instead of xdgToplevel for X11 windows. */
+        wlr_xwayland_surface *xwaylandSurface = nullptr;
         QWSceneTree *sceneTree;
 
-        QWXdgToplevelDecorationV1 *decoration;
+        QWXdgToplevelDecorationV1 *decoration = nullptr;
 
         QRect geometry;
         QRect previous_geometry;
+        bool fullscreen = false;
+        bool initialConfigured = false;
+
+        /* The same for both kinds of views. */
+        wlr_surface *surface() const;
+        QByteArray appId() const;
+        QByteArray title() const;
+        /* Relative to the surface, without client side shadows. */
+        QRect windowGeometry() const;
+        QSize minSize() const;
+        QSize maxSize() const;
+        void setSize(const QSize &size);
+        /* X11 clients place their windows themselves, tell them where they are. */
+        void syncPosition();
+        void setActivated(bool activated);
+        void setFullscreenState(bool fullscreen);
+        void close();
+        void forEachSurface(void (*iterator)(wlr_surface *surface, int sx, int sy, void *data),
+                            void *data) const;
     };
 
+    void setSimulatedAdaptiveSync(int minRefresh, int maxRefresh);
+    void appendStatistics(QByteArray *out) const;
+    /* DPMS: a powered down output keeps its place in the layout but is
+     * disabled, so it neither gets frame events nor is rendered. */
+    void setPowered(QWOutput *output, bool on);
+    void setIdle(bool idle);
+    /* For output management clients: commits all heads or none, and keeps
+     * the power state and adaptive sync policy in step with the result. */
+    bool applyConfiguration(wlr_output_configuration_v1 *config, bool testOnly);
+
+    /* Cached from the layout, only refreshed when it changes. The output
+     * containing pos, or the closest one. */
+    QWOutput *outputAt(const QPointF &pos) const;
+    QRect layoutBox(QWOutput *output) const;
+    /* Where windows go, the layout box minus what is reserved. */
+    QRect usableArea(QWOutput *output) const;
+    float scale(QWOutput *output) const;
+
+    /* Headless outputs for remote and offscreen sessions, created and
+     * destroyed at runtime. Like any other output they only render when
+     * something changed, an idle one never wakes up. refresh is in mHz,
+     * 0 for the headless default of 60Hz. */
+    bool canCreateVirtualOutputs() const;
+    QWOutput *createVirtualOutput(const QSize &size, int refresh);
+    bool isVirtualOutput(const QString &name) const;
+    bool destroyVirtualOutput(const QString &name);
+
+Q_SIGNALS:
+    void outputAdded(QWOutput *output);
+    /* Outputs were added, removed, moved or resized; the cached boxes are
+     * already up to date. */
+    void layoutChanged();
+
 private Q_SLOTS:
     void onNewOutput(QWOutput *output);
     void onOutputFrame();
-
-public:
-    QRect geometry;
-    // wlr_scene_rect *background
+    void onOutputConfigChanged(const QString &name);
+    void onOutputPresent(wlr_output_event_present *event);
+    void onFocusedViewCommitted(View *view);
+    void onViewStateChanged();
+    void onLayoutChange();
 
 private:
+    struct OutputState
+    {
+        explicit OutputState(const QByteArray &name)
+            : scheduler(name) {}
+        QBoxFrameScheduler scheduler;
+        QTimer *renderTimer = nullptr;
+        bool adaptiveSync = false;
+        bool adaptiveSyncUnsupported = false;
+        /* Set by an output management client in place of the auto policy,
+         * until the config section of the output changes. */
+        bool adaptiveSyncChosen = false;
+        bool adaptiveSyncChoice = false;
+        bool powered = true;
+        bool poweredDownByIdle = false;
+
+        QRect layoutBox;
+        QRect usableArea;
+        float scale = 1.0f;
+
+        /* The mode of a virtual output, unless its config picks another. */
+        QSize virtualSize;
+        int virtualRefresh = 0;
+
+        quint64 vsyncFlips = 0;
+        quint64 asyncFlips = 0;
+        quint64 asyncRejected = 0;
+        /* The frame on its way to the screen was committed as an async flip. */
+        bool asyncFlipPending = false;
+    };
+
+    bool configureOutput(QWOutput *output, const QBoxConfig::Output &config);
+    void renderOutput(QWOutput *output, bool tearing = false);
+    bool wantsTearing(QWOutput *output, View *view) const;
+    void updateAdaptiveSync(QWOutput *output);
+    bool wantsAdaptiveSync(QWOutput *output) const;
+
+    // wlr_scene_rect *background
     QWOutputLayout *outputLayout;
     QList<QWOutput*> outputs;
+    QHash<QWOutput*, OutputState*> m_states;
+    wlr_content_type_manager_v1 *m_contentTypeManager = nullptr;
+    wlr_tearing_control_manager_v1 *m_tearingControlManager = nullptr;
+    /* Owned by the backend, null if it can't take one. */
+    wlr_backend *m_headlessBackend = nullptr;
+    QList<QWOutput*> m_virtualOutputs;
+    /* Picked up by onNewOutput(), which runs before
+     * wlr_headless_add_output() returns. */
+    QSize m_pendingVirtualSize;
+    int m_pendingVirtualRefresh = 0;
+
+    QWSignalConnector m_sc;
+
+    bool m_firstFrame = true;
+    bool m_simulatedAdaptiveSync = false;
+    int m_simulatedMinRefresh = 0;
+    int m_simulatedMaxRefresh = 0;
 
     QBoxServer *m_server;
 };
@@ -0,0 +1,65 @@
+#include "qboxoutputmanagement.h"
+#include "qboxserver.h"
+
+extern "C" {
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/util/box.h>
+}
+
+QBoxOutputManagement::QBoxOutputManagement(QBoxServer *server):
+    m_server(server),
+    QObject(server)
+{
+    m_manager = wlr_output_manager_v1_create(server->display->handle());
+    m_sc.connect(&m_manager->events.apply, this, &QBoxOutputManagement::onApply);
+    m_sc.connect(&m_manager->events.test, this, &QBoxOutputManagement::onTest);
+    m_sc.connect(&server->output->outputLayout->handle()->events.change,
+                 this, &QBoxOutputManagement::onLayoutChange);
+}
+
+void QBoxOutputManagement::onApply(wlr_output_configuration_v1 *config)
+{
+    if (m_server->output->applyConfiguration(config, false))
+        wlr_output_configuration_v1_send_succeeded(config);
+    else
+        wlr_output_configuration_v1_send_failed(config);
+    wlr_output_configuration_v1_destroy(config);
+
+    updateConfiguration();
+}
+
+void QBoxOutputManagement::onTest(wlr_output_configuration_v1 *config)
+{
+    if (m_server->output->applyConfiguration(config, true))
+        wlr_output_configuration_v1_send_succeeded(config);
+    else
+        wlr_output_configuration_v1_send_failed(config);
+    wlr_output_configuration_v1_destroy(config);
+}
+
+void QBoxOutputManagement::onLayoutChange()
+{
+    /* A single apply moves several outputs, only advertise the end result. */
+    if (m_updatePending)
+        return;
+    m_updatePending = true;
+    QMetaObject::invokeMethod(this, &QBoxOutputManagement::updateConfiguration, Qt::QueuedConnection);
+}
+
+void QBoxOutputManagement::updateConfiguration()
+{
+    m_updatePending = false;
+
+    auto *config = wlr_output_configuration_v1_create();
+    auto *layout = m_server->output->outputLayout->handle();
+    for (QWOutput *output : std::as_const(m_server->output->outputs)) {
+        auto *head = wlr_output_configuration_head_v1_create(config, output->handle());
+        wlr_box box;
+        wlr_output_layout_get_box(layout, output->handle(), &box);
+        if (!wlr_box_empty(&box)) {
+            head->state.x = box.x;
+            head->state.y = box.y;
+        }
+    }
+    wlr_output_manager_v1_set_configuration(m_manager, config);
+}
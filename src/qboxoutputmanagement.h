@@ -0,0 +1,35 @@
+#ifndef QBOXOUTPUTMANAGEMENT_H
+#define QBOXOUTPUTMANAGEMENT_H
+
+#include <qwsignalconnector.h>
+#include <QObject>
+
+extern "C" {
+#include <wlr/types/wlr_output_management_v1.h>
+}
+
+using QW_NAMESPACE::QWSignalConnector;
+
+class QBoxServer;
+
+class QBoxOutputManagement : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QBoxOutputManagement(QBoxServer *server);
+
+private:
+    void onApply(wlr_output_configuration_v1 *config);
+    void onTest(wlr_output_configuration_v1 *config);
+    void onLayoutChange();
+
+    void updateConfiguration();
+
+    wlr_output_manager_v1 *m_manager;
+    QWSignalConnector m_sc;
+    bool m_updatePending = false;
+
+    QBoxServer *m_server;
+};
+
+#endif // QBOXOUTPUTMANAGEMENT_H
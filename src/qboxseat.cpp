@@ -6,6 +6,16 @@
 #include <qwprimaryselection.h>
 #include <QCoreApplication>
 
+#include <cstdlib>
+#include <cstring>
+
+extern "C" {
+#include <wlr/types/wlr_cursor.h>
+#include <wlr/types/wlr_touch.h>
+#include <wlr/types/wlr_virtual_keyboard_v1.h>
+#include <wlr/types/wlr_virtual_pointer_v1.h>
+}
+
 QBoxSeat::QBoxSeat(QBoxServer *server):
     m_server(server),
     QObject(server)
@@ -17,37 +27,85 @@ QBoxSeat::QBoxSeat(QBoxServer *server):
     connect(m_seat, &QWSeat::requestSetCursor, this, &QBoxSeat::onRequestSetCursor);
     connect(m_seat, &QWSeat::requestSetSelection, this, &QBoxSeat::onRequestSetSelection);
     connect(m_seat, &QWSeat::requestSetPrimarySelection, this, &QBoxSeat::onRequestSetPrimarySelection);
+
+    m_keybindings = new QBoxKeybindings(server);
+    m_clipboard = new QBoxClipboard(server, m_seat);
+
+    connect(server->config, &QBoxConfig::keymapChanged, this, &QBoxSeat::onKeymapChanged);
+    connect(server->config, &QBoxConfig::repeatInfoChanged, this, &QBoxSeat::onRepeatInfoChanged);
+    /* Touchscreens may show up before their panel. */
+    connect(server->output, &QBoxOutPut::outputAdded, this, [this] {
+        for (QWInputDevice *device : std::as_const(m_touchDevices))
+            mapTouchDevice(device);
+    });
+
+    m_virtualKeyboardManager = wlr_virtual_keyboard_manager_v1_create(server->display->handle());
+    m_sc.connect(&m_virtualKeyboardManager->events.new_virtual_keyboard,
+                 this, &QBoxSeat::onNewVirtualKeyboard);
+    m_virtualPointerManager = wlr_virtual_pointer_manager_v1_create(server->display->handle());
+    m_sc.connect(&m_virtualPointerManager->events.new_virtual_pointer,
+                 this, &QBoxSeat::onNewVirtualPointer);
 }
 
+QBoxSeat::~QBoxSeat()
+{
+    if (m_keymap)
+        xkb_keymap_unref(m_keymap);
+}
+
+
+void QBoxSeat::appendMemoryStatistics(QByteArray *out) const
+{
+    *out += "memory.seat.keyboards=" + QByteArray::number(m_keyboards.size()) + '\n';
+    *out += "memory.seat.virtual_keyboards=" + QByteArray::number(m_virtualKeyboards.size()) + '\n';
+    /* The compiled keymap isn't exposed, its text form is the closest
+     * measure of how big it is. Every keyboard shares it. */
+    qint64 keymapBytes = 0;
+    if (m_keymap) {
+        if (char *text = xkb_keymap_get_as_string(m_keymap, XKB_KEYMAP_FORMAT_TEXT_V1)) {
+            keymapBytes = qint64(strlen(text));
+            free(text);
+        }
+    }
+    *out += "memory.seat.keymap_text_bytes=" + QByteArray::number(keymapBytes) + '\n';
+}
 
 void QBoxSeat::onRequestSetCursor(wlr_seat_pointer_request_set_cursor_event *event)
 {
     if (m_seat->handle()->pointer_state.focused_client == event->seat_client)
-        m_server->cursor->m_cursor->setSurface(QWSurface::from(event->surface), QPoint(event->hotspot_x, event->hotspot_y));
+        m_server->cursor->setSurfaceImage(event->surface, QPoint(event->hotspot_x, event->hotspot_y));
 }
 
 void QBoxSeat::onRequestSetSelection(wlr_seat_request_set_selection_event *event)
 {
     m_seat->setSelection(event->source, event->serial);
+    m_clipboard->selectionChanged(event->source);
 }
 
 void QBoxSeat::onRequestSetPrimarySelection(wlr_seat_request_set_primary_selection_event *event)
 {
     auto *primarySelectionSource = QWPrimarySelectionSource::from(event->source);
     primarySelectionSource->setPrimarySelection(m_seat, event->serial);
+    m_clipboard->primarySelectionChanged(event->source);
 }
 
 void QBoxSeat::onNewInput(QWInputDevice *device)
 {
     if (QWKeyboard *keyboard = qobject_cast<QWKeyboard*>(device)) {
-
-        xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
-        xkb_keymap *keymap = xkb_keymap_new_from_names(context, nullptr, XKB_KEYMAP_COMPILE_NO_FLAGS);
-
-        keyboard->setKeymap(keymap);
-        xkb_keymap_unref(keymap);
-        xkb_context_unref(context);
-        keyboard->setRepeatInfo(25, 600);
+        auto config = m_server->config->current();
+        /* A virtual keyboard has to send its keymap before any key, ours
+         * would only be replaced. */
+        if (!m_virtualKeyboards.contains(keyboard)) {
+            if (m_keymap) {
+                keyboard->setKeymap(m_keymap);
+            } else if (!m_keymapPending) {
+                /* Keyboards show up while the backend starts, compile
+                 * once the event loop runs instead of holding it up. */
+                m_keymapPending = true;
+                QMetaObject::invokeMethod(this, &QBoxSeat::ensureKeymap, Qt::QueuedConnection);
+            }
+        }
+        keyboard->setRepeatInfo(config->keyboard.repeatRate, config->keyboard.repeatDelay);
 
         connect(keyboard, &QWKeyboard::modifiers, this, &QBoxSeat::onKeyboardModifiers);
         connect(keyboard, &QWKeyboard::key, this, &QBoxSeat::onKeyboardKey);
@@ -62,18 +120,74 @@ void QBoxSeat::onNewInput(QWInputDevice *device)
         Q_ASSERT(m_server->cursor);
         Q_ASSERT(m_server->cursor->m_cursor);
         m_server->cursor->m_cursor->attachInputDevice(device);
+    } else if (device->handle()->type == WLR_INPUT_DEVICE_TOUCH) {
+        /* wlr_cursor maps touch points to the layout, it doesn't move the
+         * pointer for them. */
+        m_server->cursor->m_cursor->attachInputDevice(device);
+        mapTouchDevice(device);
+        m_touchDevices.append(device);
+        connect(device, &QObject::destroyed, this, [this, device] {
+            m_touchDevices.removeOne(device);
+            updateCapabilities();
+        });
     }
 
+    updateCapabilities();
+}
+
+void QBoxSeat::mapTouchDevice(QWInputDevice *device)
+{
+    /* A touchscreen covers its own panel only. */
+    wlr_touch *touch = wlr_touch_from_input_device(device->handle());
+    if (!touch->output_name)
+        return;
+    for (QWOutput *output : std::as_const(m_server->output->outputs)) {
+        if (qstrcmp(touch->output_name, output->handle()->name) == 0) {
+            wlr_cursor_map_input_to_output(m_server->cursor->m_cursor->handle(), device->handle(),
+                                           output->handle());
+            return;
+        }
+    }
+}
+
+void QBoxSeat::updateCapabilities()
+{
     uint32_t caps = WL_SEAT_CAPABILITY_POINTER;
     if (!m_keyboards.isEmpty()) {
         caps |= WL_SEAT_CAPABILITY_KEYBOARD;
     }
+    if (!m_touchDevices.isEmpty())
+        caps |= WL_SEAT_CAPABILITY_TOUCH;
     m_seat->setCapabilities(caps);
 }
 
+void QBoxSeat::onNewVirtualKeyboard(wlr_virtual_keyboard_v1 *keyboard)
+{
+    auto *device = QWKeyboard::from(&keyboard->keyboard);
+    m_virtualKeyboards.append(device);
+    onNewInput(device);
+}
+
+void QBoxSeat::onNewVirtualPointer(wlr_virtual_pointer_v1_new_pointer_event *event)
+{
+    auto *device = QWPointer::from(&event->new_pointer->pointer);
+    onNewInput(device);
+    /* Absolute motion then spans that output instead of the layout. */
+    if (event->suggested_output)
+        wlr_cursor_map_input_to_output(m_server->cursor->m_cursor->handle(), device->handle(),
+                                       event->suggested_output);
+}
+
 void QBoxSeat::onKeyboardModifiers()
 {
     QWKeyboard *keyboard = qobject_cast<QWKeyboard*>(QObject::sender());
+    if (!keyboard->handle()->keymap)
+        ensureKeymap();
+    m_server->idle->notifyActivity();
+    /* The switcher is held open by the modifiers that opened it. */
+    if (m_server->switcher->isActive()
+            && !(keyboard->getModifiers() & ~(WLR_MODIFIER_CAPS | WLR_MODIFIER_MOD2)))
+        m_server->switcher->commit();
     m_seat->setKeyboard(keyboard);
     m_seat->keyboardNotifyModifiers(&keyboard->handle()->modifiers);
 }
@@ -81,17 +195,20 @@ void QBoxSeat::onKeyboardModifiers()
 void QBoxSeat::onKeyboardKey(wlr_keyboard_key_event *event)
 {
     QWKeyboard *keyboard = qobject_cast<QWKeyboard*>(QObject::sender());
-    /* Translate libinput keycode -> xkbcommon */
-    uint32_t keycode = event->keycode + 8;
-    const xkb_keysym_t *syms;
-    int nsyms = xkb_state_key_get_syms(keyboard->handle()->xkb_state, keycode, &syms);
+    /* Typed before the queued compile ran. */
+    if (!keyboard->handle()->keymap)
+        ensureKeymap();
+    m_server->idle->notifyActivity();
 
     bool handled = false;
-    uint32_t modifiers = keyboard->getModifiers();
-    if ((modifiers & (WLR_MODIFIER_ALT | WLR_MODIFIER_CTRL))
-            && event->state == WL_KEYBOARD_KEY_STATE_PRESSED) {
-        for (int i = 0; i < nsyms; i++)
-            handled = handleKeybinding(syms[i]);
+    if (event->state == WL_KEYBOARD_KEY_STATE_PRESSED && m_server->switcher->isActive()
+            && xkb_state_key_get_one_sym(keyboard->handle()->xkb_state, event->keycode + 8) == XKB_KEY_Escape) {
+        m_server->switcher->cancel();
+        handled = true;
+    } else if (event->state == WL_KEYBOARD_KEY_STATE_PRESSED) {
+        /* Translate libinput keycode -> xkbcommon */
+        handled = m_keybindings->handleKey(keyboard->handle()->xkb_state, event->keycode + 8,
+                                           keyboard->getModifiers());
     }
 
     if (!handled) {
@@ -104,23 +221,67 @@ void QBoxSeat::onKeyboardDestroy()
 {
     QWKeyboard *keyboard = qobject_cast<QWKeyboard*>(QObject::sender());
     m_keyboards.removeOne(keyboard);
+    m_virtualKeyboards.removeOne(keyboard);
 }
 
-bool QBoxSeat::handleKeybinding(xkb_keysym_t sym)
-{
-    auto *xdgShell = m_server->xdgShell;
-    switch (sym) {
-    case XKB_KEY_Escape:
-        m_server->display->terminate();
-        qApp->exit();
-        break;
-    case XKB_KEY_F1:
-        if (m_server->views.size() < 2)
-            break;
-        xdgShell->focusView(m_server->views.at(1), m_server->views.at(1)->xdgToplevel->handle()->base->surface);
-        break;
-    default:
-        return false;
+xkb_keymap *QBoxSeat::compileKeymap() const
+{
+    auto config = m_server->config->current();
+    const auto &keyboard = config->keyboard;
+    const QByteArray rules = keyboard.rules.toUtf8();
+    const QByteArray model = keyboard.model.toUtf8();
+    const QByteArray layout = keyboard.layout.toUtf8();
+    const QByteArray variant = keyboard.variant.toUtf8();
+    const QByteArray options = keyboard.options.toUtf8();
+    /* Empty names fall back to the XKB_DEFAULT_* environment. */
+    auto name = [](const QByteArray &value) {
+        return value.isEmpty() ? nullptr : value.constData();
+    };
+    const xkb_rule_names names {
+        name(rules), name(model), name(layout), name(variant), name(options)
+    };
+
+    xkb_context *context = xkb_context_new(XKB_CONTEXT_NO_FLAGS);
+    xkb_keymap *keymap = xkb_keymap_new_from_names(context, &names, XKB_KEYMAP_COMPILE_NO_FLAGS);
+    if (!keymap) {
+        qWarning("failed to compile keymap, falling back to the default one");
+        keymap = xkb_keymap_new_from_names(context, nullptr, XKB_KEYMAP_COMPILE_NO_FLAGS);
     }
-    return true;
+    xkb_context_unref(context);
+    return keymap;
+}
+
+void QBoxSeat::ensureKeymap()
+{
+    m_keymapPending = false;
+    if (!m_keymap)
+        m_keymap = compileKeymap();
+    for (QWKeyboard *keyboard : std::as_const(m_keyboards)) {
+        if (!m_virtualKeyboards.contains(keyboard) && keyboard->handle()->keymap != m_keymap)
+            keyboard->setKeymap(m_keymap);
+    }
+}
+
+void QBoxSeat::onKeymapChanged()
+{
+    /* Nothing to do until the first keyboard shows up. */
+    if (!m_keymap)
+        return;
+
+    xkb_keymap *keymap = compileKeymap();
+    if (!keymap)
+        return;
+    xkb_keymap_unref(m_keymap);
+    m_keymap = keymap;
+    for (QWKeyboard *keyboard : std::as_const(m_keyboards)) {
+        if (!m_virtualKeyboards.contains(keyboard))
+            keyboard->setKeymap(m_keymap);
+    }
+}
+
+void QBoxSeat::onRepeatInfoChanged()
+{
+    auto config = m_server->config->current();
+    for (QWKeyboard *keyboard : std::as_const(m_keyboards))
+        keyboard->setRepeatInfo(config->keyboard.repeatRate, config->keyboard.repeatDelay);
 }
@@ -5,6 +5,9 @@
 #include <qwkeyboard.h>
 #include <qwinputdevice.h>
 #include <qwprimaryselectionv1.h>
+#include <qwsignalconnector.h>
+#include "qboxkeybindings.h"
+#include "qboxclipboard.h"
 #include <QObject>
 
 extern "C" {
@@ -15,6 +18,12 @@ using QW_NAMESPACE::QWSeat;
 using QW_NAMESPACE::QWKeyboard;
 using QW_NAMESPACE::QWInputDevice;
 using QW_NAMESPACE::QWPrimarySelectionV1DeviceManager;
+using QW_NAMESPACE::QWSignalConnector;
+
+struct wlr_virtual_keyboard_manager_v1;
+struct wlr_virtual_keyboard_v1;
+struct wlr_virtual_pointer_manager_v1;
+struct wlr_virtual_pointer_v1_new_pointer_event;
 
 class QBoxServer;
 
@@ -23,8 +32,14 @@ class QBoxSeat : public QObject
     Q_OBJECT
     friend class QBoxXdgShell;
     friend class QBoxCursor;
+    friend class QBoxIdle;
+    friend class QBoxXwayland;
 public:
     explicit QBoxSeat(QBoxServer *server = nullptr);
+    ~QBoxSeat();
+
+    /* Keyboards and the shared keymap. */
+    void appendMemoryStatistics(QByteArray *out) const;
 
 private:
     void onRequestSetCursor(wlr_seat_pointer_request_set_cursor_event *event);
@@ -32,15 +47,34 @@ private:
     void onRequestSetPrimarySelection(wlr_seat_request_set_primary_selection_event *event);
 
     void onNewInput(QWInputDevice *device);
+    void updateCapabilities();
+    void mapTouchDevice(QWInputDevice *device);
+    /* For automation and tests, handled like any other device. */
+    void onNewVirtualKeyboard(wlr_virtual_keyboard_v1 *keyboard);
+    void onNewVirtualPointer(wlr_virtual_pointer_v1_new_pointer_event *event);
 
     void onKeyboardModifiers();
     void onKeyboardKey(wlr_keyboard_key_event *event);
     void onKeyboardDestroy();
-    bool handleKeybinding(xkb_keysym_t sym);
+    void onKeymapChanged();
+    void onRepeatInfoChanged();
+    xkb_keymap *compileKeymap() const;
+    void ensureKeymap();
 
     QWSeat *m_seat;
     QWPrimarySelectionV1DeviceManager *m_primarySelectionV1DeviceManager;
     QList<QWKeyboard*> m_keyboards;
+    /* Compiled once and shared by every keyboard, except virtual ones
+     * which bring their own. */
+    xkb_keymap *m_keymap = nullptr;
+    bool m_keymapPending = false;
+    QList<QWKeyboard*> m_virtualKeyboards;
+    QList<QWInputDevice*> m_touchDevices;
+    wlr_virtual_keyboard_manager_v1 *m_virtualKeyboardManager;
+    wlr_virtual_pointer_manager_v1 *m_virtualPointerManager;
+    QWSignalConnector m_sc;
+    QBoxKeybindings *m_keybindings;
+    QBoxClipboard *m_clipboard;
 
     QBoxServer *m_server;
 };
@@ -3,13 +3,31 @@
 
 #include <QGuiApplication>
 #include <QLoggingCategory>
+#include <QFile>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <malloc.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 QBoxServer::QBoxServer()
 {
+    m_startupTimer.start();
+    config = new QBoxConfig(this);
     display = new QWDisplay(this);
+    /* Bound right away so that clients started alongside us can connect,
+     * nothing is accepted before the event loop runs. */
+    if (const char *socket = display->addSocketAuto())
+        m_socket = socket;
+    startupPhase("config and socket");
+
     backend = QWBackend::autoCreate(display, this);
     if (!backend)
         qFatal("failed to create wlr_backend");
+    startupPhase("backend");
 
     renderer = QWRenderer::autoCreate(backend);
     if (!renderer)
@@ -19,12 +37,14 @@ QBoxServer::QBoxServer()
     allocator = QWAllocator::autoCreate(backend, renderer);
     if (!allocator)
         qFatal("failed to create wlr_allocator");
+    startupPhase("renderer");
 
     compositor = QWCompositor::create(display, renderer);
     subcompositor = QWSubcompositor::create(display);
     dataDeviceManager = QWDataDeviceManager::create(display);
 
     output = new QBoxOutPut(this);
+    outputManagement = new QBoxOutputManagement(this);
     /* Set up the xdg-shell. The xdg-shell is a Wayland protocol which is used
      * for application windows. For more detail on shells, refer to Drew
      * DeVault's article:
@@ -33,9 +53,19 @@ QBoxServer::QBoxServer()
     */
     xdgShell = new QBoxXdgShell(this);
     layerShell = new QBoxLayerShell(this);
+    clients = new QBoxClientAccounting(this);
     decoration = new QBoxDecoration(this);
+    startupPhase("outputs and shells");
+    /* The cursor theme and the keymap are only loaded once needed. */
     cursor = new QBoxCursor(this);
     seat = new QBoxSeat(this);
+    startupPhase("input");
+    idle = new QBoxIdle(this);
+    switcher = new QBoxSwitcher(this);
+    xwayland = new QBoxXwayland(this);
+    foreignToplevel = new QBoxForeignToplevel(this);
+    ipc = new QBoxIpc(this);
+    startupPhase("other globals");
 }
 
 QBoxServer::~QBoxServer()
@@ -45,18 +75,93 @@ QBoxServer::~QBoxServer()
 
 bool QBoxServer::start()
 {
-    const char *socket = display->addSocketAuto();
-    if (!socket) {
+    if (m_socket.isEmpty()) {
         return false;
     }
+    const char *socket = m_socket.constData();
 
     if (!backend->start())
         return false;
+    startupPhase("backend start");
 
-    qputenv("WAYLAND_DISPLAY", QByteArray(socket));
+    qputenv("WAYLAND_DISPLAY", m_socket);
     qInfo("Running Wayland compositor on WAYLAND_DISPLAY=%s", socket);
 
+    /* The control socket is optional, automation simply won't find it. */
+    const QByteArray runtimeDir = qgetenv("XDG_RUNTIME_DIR");
+    const QByteArray ipcPath = runtimeDir + "/qwlbox." + socket + ".sock";
+    if (!runtimeDir.isEmpty() && ipc->start(ipcPath)) {
+        qputenv("QWLBOX_SOCKET", ipcPath);
+        qInfo("Listening for IPC on QWLBOX_SOCKET=%s", ipcPath.constData());
+    }
+
     display->start(qApp->thread());
     return true;
 }
 
+void QBoxServer::notifyReady(int readyFd)
+{
+    startupPhase("ready");
+    if (readyFd >= 0) {
+        const QByteArray line = m_socket + '\n';
+        if (write(readyFd, line.constData(), line.size()) < 0)
+            qWarning("failed to write to the readiness fd: %s", strerror(errno));
+        close(readyFd);
+    }
+
+    /* sd_notify() without linking libsystemd. */
+    const QByteArray path = qgetenv("NOTIFY_SOCKET");
+    if (path.isEmpty())
+        return;
+    /* Not for whatever we spawn. */
+    qunsetenv("NOTIFY_SOCKET");
+    sockaddr_un addr {};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= qsizetype(sizeof(addr.sun_path)) || (path[0] != '/' && path[0] != '@'))
+        return;
+    memcpy(addr.sun_path, path.constData(), path.size());
+    /* Abstract namespace. */
+    if (addr.sun_path[0] == '@')
+        addr.sun_path[0] = '\0';
+    const int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return;
+    static const char message[] = "READY=1";
+    if (sendto(fd, message, sizeof(message) - 1, MSG_NOSIGNAL, reinterpret_cast<sockaddr*>(&addr),
+               socklen_t(offsetof(sockaddr_un, sun_path) + path.size())) < 0)
+        qWarning("failed to notify %s: %s", path.constData(), strerror(errno));
+    close(fd);
+}
+
+void QBoxServer::startupPhase(const char *name)
+{
+    const qint64 now = m_startupTimer.nsecsElapsed() / 1000;
+    qInfo("startup: %s took %lld us, %lld us in total", name, now - m_lastPhase, now);
+    m_startupPhases.append({ QByteArray(name).replace(' ', '_'), now });
+    m_lastPhase = now;
+}
+
+void QBoxServer::appendMemoryStatistics(QByteArray *out) const
+{
+    QFile statm(QStringLiteral("/proc/self/statm"));
+    if (statm.open(QIODevice::ReadOnly)) {
+        const QList<QByteArray> pages = statm.readAll().split(' ');
+        const qint64 pageSize = sysconf(_SC_PAGESIZE);
+        *out += "memory.process.vm=" + QByteArray::number(pages.value(0).toLongLong() * pageSize) + '\n';
+        *out += "memory.process.rss=" + QByteArray::number(pages.value(1).toLongLong() * pageSize) + '\n';
+    }
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    /* What is actually allocated, RSS also counts what malloc keeps. */
+    const struct mallinfo2 heap = mallinfo2();
+    *out += "memory.heap.used=" + QByteArray::number(qulonglong(heap.uordblks + heap.hblkhd)) + '\n';
+    *out += "memory.heap.free=" + QByteArray::number(qulonglong(heap.fordblks)) + '\n';
+#endif
+    *out += "memory.qt.objects=" + QByteArray::number(findChildren<QObject*>().size()) + '\n';
+}
+
+void QBoxServer::appendStatistics(QByteArray *out) const
+{
+    for (const auto &[name, time] : m_startupPhases)
+        *out += "startup." + name + "_us=" + QByteArray::number(time) + '\n';
+}
+
@@ -1,16 +1,23 @@
 #ifndef SERVER_H
 #define SERVER_H
 
-#define TITLEBAR_HEIGHT 8 /* TODO: Get this from the theme */
-
+#include "qboxconfig.h"
 #include "qboxdecoration.h"
 #include "qboxcursor.h"
 #include "qboxseat.h"
 #include "qboxoutput.h"
+#include "qboxoutputmanagement.h"
 #include "qboxxdgshell.h"
 #include "qboxlayershell.h"
+#include "qboxipc.h"
+#include "qboxidle.h"
+#include "qboxclientaccounting.h"
+#include "qboxswitcher.h"
+#include "qboxxwayland.h"
+#include "qboxforeigntoplevel.h"
 
 #include <QRect>
+#include <QElapsedTimer>
 
 #include <qwbackend.h>
 #include <qwdisplay.h>
@@ -57,6 +64,7 @@ class QBoxServer : public QObject
     friend class QBoxOutPut;
     friend class QBoxXdgShell;
     friend class QBoxLayerShell;
+    friend class QBoxIpc;
     using View = QBoxOutPut::View;
 
 public:
@@ -64,6 +72,16 @@ public:
     ~QBoxServer();
 
     bool start();
+    /* Once start() succeeded and whatever the command line asks for exists.
+     * readyFd, if any, gets the Wayland socket name and a newline,
+     * $NOTIFY_SOCKET gets READY=1 at the same time. */
+    void notifyReady(int readyFd = -1);
+    /* Logs how long startup took up to here and since the last phase,
+     * the IPC stats report them too. */
+    void startupPhase(const char *name);
+    void appendStatistics(QByteArray *out) const;
+    /* The process as a whole, each subsystem reports what it holds. */
+    void appendMemoryStatistics(QByteArray *out) const;
 
     QWDisplay *display;
     QWBackend *backend;
@@ -74,18 +92,32 @@ public:
     QWSubcompositor *subcompositor;
     QWDataDeviceManager *dataDeviceManager;
 
+    QBoxConfig *config;
     QBoxOutPut *output;
+    QBoxOutputManagement *outputManagement;
     QBoxXdgShell *xdgShell;
     QBoxLayerShell *layerShell;
+    QBoxClientAccounting *clients;
     QBoxDecoration *decoration;
     QBoxCursor *cursor;
     QBoxSeat *seat;
+    QBoxIdle *idle;
+    QBoxSwitcher *switcher;
+    QBoxXwayland *xwayland;
+    QBoxForeignToplevel *foreignToplevel;
+    QBoxIpc *ipc;
 
     QList<View*> views;
     View *grabbedView = nullptr;
     QPointF grabCursorPos;
     QRectF grabGeoBox;
     uint32_t resizingEdges = 0;
+
+private:
+    QElapsedTimer m_startupTimer;
+    qint64 m_lastPhase = 0;
+    QList<std::pair<QByteArray, qint64>> m_startupPhases;
+    QByteArray m_socket;
 };
 
 #endif // SERVER_H
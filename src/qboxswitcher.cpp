@@ -0,0 +1,329 @@
+#include "qboxswitcher.h"
+#include "qboxserver.h"
+#include "qwconfig.h"
+
+#include <QTimer>
+
+#include <cmath>
+
+extern "C" {
+#include <drm_fourcc.h>
+#include <wlr/render/allocator.h>
+#include <wlr/render/wlr_renderer.h>
+#include <wlr/types/wlr_matrix.h>
+#include <wlr/types/wlr_output_layout.h>
+}
+
+/* Every thumbnail gets a cell of this size, pages hold a grid of them. */
+static constexpr int CellWidth = 256;
+static constexpr int CellHeight = 160;
+static constexpr int PageSize = 2048;
+static constexpr int PageColumns = PageSize / CellWidth;
+static constexpr int CellsPerPage = PageColumns * (PageSize / CellHeight);
+/* Thumbnails of an open switcher are redrawn at most this often. */
+static constexpr int ThumbnailRate = 10; // Hz
+static constexpr int Spacing = 16;
+static constexpr int Margin = 32;
+
+static wlr_box cellBox(int cell)
+{
+    return { (cell % PageColumns) * CellWidth, (cell / PageColumns) * CellHeight, CellWidth, CellHeight };
+}
+
+QBoxSwitcher::QBoxSwitcher(QBoxServer *server):
+    m_server(server),
+    QObject(server)
+{
+    m_refreshTimer = new QTimer(this);
+    m_refreshTimer->setSingleShot(true);
+    m_refreshTimer->setInterval(1000 / ThumbnailRate);
+    connect(m_refreshTimer, &QTimer::timeout, this, &QBoxSwitcher::renderDirty);
+
+    connect(server->xdgShell, &QBoxXdgShell::viewMapped, this, &QBoxSwitcher::onViewMapped);
+    connect(server->xdgShell, &QBoxXdgShell::viewUnmapped, this, &QBoxSwitcher::onViewUnmapped);
+}
+
+QBoxSwitcher::~QBoxSwitcher()
+{
+    for (const Page &page : std::as_const(m_pages))
+        wlr_buffer_drop(page.buffer);
+}
+
+void QBoxSwitcher::onViewMapped(View *view)
+{
+    Thumbnail &thumbnail = m_thumbnails[view];
+    wlr_surface *surface = view->surface();
+    /* Just a flag, nothing is drawn until the switcher needs it. */
+    thumbnail.commit = connect(QWSurface::from(surface), &QWSurface::commit, this, [this, view, surface] {
+        if (!pixman_region32_not_empty(&surface->buffer_damage))
+            return;
+        m_thumbnails[view].dirty = true;
+        if (isActive() && !m_refreshTimer->isActive())
+            m_refreshTimer->start();
+    });
+}
+
+void QBoxSwitcher::onViewUnmapped(View *view)
+{
+    auto it = m_thumbnails.find(view);
+    if (it == m_thumbnails.end())
+        return;
+    disconnect(it->commit);
+    if (it->page >= 0)
+        m_pages[it->page].used[it->cell] = false;
+    m_thumbnails.erase(it);
+
+    if (isActive() && m_order.removeOne(view)) {
+        if (m_order.isEmpty()) {
+            close();
+            return;
+        }
+        m_selected = qMin(m_selected, int(m_order.size()) - 1);
+        layout();
+        step(0);
+    }
+}
+
+bool QBoxSwitcher::allocateCell(Thumbnail *thumbnail)
+{
+    for (int page = 0; page < m_pages.size(); ++page) {
+        const int cell = m_pages.at(page).used.indexOf(false);
+        if (cell >= 0) {
+            m_pages[page].used[cell] = true;
+            thumbnail->page = page;
+            thumbnail->cell = cell;
+            return true;
+        }
+    }
+
+    wlr_renderer *renderer = m_server->renderer->handle();
+    const wlr_drm_format *format = wlr_drm_format_set_get(wlr_renderer_get_render_formats(renderer),
+                                                          DRM_FORMAT_ARGB8888);
+    wlr_buffer *buffer = format ? wlr_allocator_create_buffer(m_server->allocator->handle(),
+                                                              PageSize, PageSize, format)
+                                : nullptr;
+    if (!buffer) {
+        qWarning("failed to allocate a thumbnail page");
+        return false;
+    }
+    Page page { buffer, QList<bool>(CellsPerPage, false) };
+    page.used[0] = true;
+    m_pages.append(page);
+    thumbnail->page = m_pages.size() - 1;
+    thumbnail->cell = 0;
+    return true;
+}
+
+void QBoxSwitcher::renderDirty()
+{
+    QHash<int, QList<View*>> dirty;
+    for (auto it = m_thumbnails.begin(); it != m_thumbnails.end(); ++it) {
+        if (!it->dirty)
+            continue;
+        if (it->page < 0 && !allocateCell(&it.value()))
+            continue;
+        it->dirty = false;
+        dirty[it->page].append(it.key());
+    }
+
+    /* One render pass per page, however many thumbnails changed on it. */
+    for (auto it = dirty.cbegin(); it != dirty.cend(); ++it) {
+        renderPage(it.key(), it.value());
+        for (View *view : it.value()) {
+            if (wlr_scene_buffer *node = m_thumbnails.value(view).node)
+                wlr_scene_buffer_set_buffer(node, m_pages.at(it.key()).buffer);
+        }
+    }
+}
+
+namespace {
+struct RenderContext
+{
+    wlr_renderer *renderer;
+    wlr_box cell;
+    QPoint origin;
+    double scale;
+#if WLR_VERSION_MINOR > 17
+    wlr_render_pass *pass;
+    pixman_region32_t clip;
+#endif
+};
+}
+
+void QBoxSwitcher::renderPage(int page, const QList<View*> &views)
+{
+    wlr_renderer *renderer = m_server->renderer->handle();
+    wlr_buffer *buffer = m_pages.at(page).buffer;
+
+    /* Every surface of the view, popups included, scaled to fit the cell
+     * with the window geometry (not the client side shadow) centered. */
+    auto renderSurface = [](wlr_surface *surface, int sx, int sy, void *data) {
+        auto *context = static_cast<RenderContext*>(data);
+        wlr_texture *texture = wlr_surface_get_texture(surface);
+        if (!texture)
+            return;
+        const wlr_box box {
+            context->origin.x() + int(std::floor(sx * context->scale)),
+            context->origin.y() + int(std::floor(sy * context->scale)),
+            int(std::ceil(surface->current.width * context->scale)),
+            int(std::ceil(surface->current.height * context->scale)),
+        };
+#if WLR_VERSION_MINOR > 17
+        wlr_render_texture_options options {};
+        options.texture = texture;
+        options.dst_box = box;
+        options.clip = &context->clip;
+        options.transform = surface->current.transform;
+        options.filter_mode = WLR_SCALE_FILTER_BILINEAR;
+        wlr_render_pass_add_texture(context->pass, &options);
+#else
+        float identity[9];
+        float matrix[9];
+        wlr_matrix_identity(identity);
+        wlr_matrix_project_box(matrix, &box, wlr_output_transform_invert(surface->current.transform),
+                               0, identity);
+        wlr_render_texture_with_matrix(context->renderer, texture, matrix, 1.0f);
+#endif
+    };
+
+    RenderContext context {};
+    context.renderer = renderer;
+#if WLR_VERSION_MINOR > 17
+    context.pass = wlr_renderer_begin_buffer_pass(renderer, buffer, nullptr);
+    if (!context.pass)
+        return;
+#else
+    if (!wlr_renderer_begin_with_buffer(renderer, buffer))
+        return;
+#endif
+
+    for (View *view : views) {
+        const Thumbnail &thumbnail = m_thumbnails.value(view);
+        const QRect windowGeometry = view->windowGeometry();
+        const wlr_box geometry { windowGeometry.x(), windowGeometry.y(),
+                                 windowGeometry.width(), windowGeometry.height() };
+        if (geometry.width <= 0 || geometry.height <= 0)
+            continue;
+
+        context.cell = cellBox(thumbnail.cell);
+        context.scale = std::min({ 1.0, double(CellWidth) / geometry.width,
+                                   double(CellHeight) / geometry.height });
+        const QSize size(int(geometry.width * context.scale), int(geometry.height * context.scale));
+        context.origin = QPoint(context.cell.x + (CellWidth - size.width()) / 2
+                                - int(geometry.x * context.scale),
+                                context.cell.y + (CellHeight - size.height()) / 2
+                                - int(geometry.y * context.scale));
+
+#if WLR_VERSION_MINOR > 17
+        wlr_render_rect_options clear {};
+        clear.box = context.cell;
+        clear.color = { 0, 0, 0, 0 };
+        clear.blend_mode = WLR_RENDER_BLEND_MODE_NONE;
+        wlr_render_pass_add_rect(context.pass, &clear);
+        pixman_region32_init_rect(&context.clip, context.cell.x, context.cell.y,
+                                  context.cell.width, context.cell.height);
+        view->forEachSurface(renderSurface, &context);
+        pixman_region32_fini(&context.clip);
+#else
+        static const float transparent[4] = { 0, 0, 0, 0 };
+        wlr_renderer_scissor(renderer, &context.cell);
+        wlr_renderer_clear(renderer, transparent);
+        view->forEachSurface(renderSurface, &context);
+#endif
+    }
+
+#if WLR_VERSION_MINOR > 17
+    wlr_render_pass_submit(context.pass);
+#else
+    wlr_renderer_scissor(renderer, nullptr);
+    wlr_renderer_end(renderer);
+#endif
+}
+
+void QBoxSwitcher::step(int direction)
+{
+    if (!isActive()) {
+        if (m_server->views.size() < 2)
+            return;
+        m_order = m_server->views;
+        m_selected = 0;
+        /* Whatever changed while closed is drawn once, now. */
+        renderDirty();
+        layout();
+    }
+    m_selected = (m_selected + direction + m_order.size()) % m_order.size();
+    wlr_scene_node_set_position(&m_highlight->node,
+                                Spacing + (m_selected % m_columns) * (CellWidth + Spacing) - Spacing / 2,
+                                Spacing + (m_selected / m_columns) * (CellHeight + Spacing) - Spacing / 2);
+}
+
+void QBoxSwitcher::layout()
+{
+    if (m_tree)
+        wlr_scene_node_destroy(&m_tree->node);
+    for (View *view : std::as_const(m_order))
+        m_thumbnails[view].node = nullptr;
+
+    auto *outputs = m_server->output;
+    const QRect box = outputs->layoutBox(outputs->outputAt(m_server->cursor->getCursor()->position()));
+
+    const int count = m_order.size();
+    const int columns = qBound(1, (box.width() - 2 * Margin - Spacing) / (CellWidth + Spacing), count);
+    m_columns = columns;
+    const int rows = (count + columns - 1) / columns;
+    const int width = columns * (CellWidth + Spacing) + Spacing;
+    const int height = rows * (CellHeight + Spacing) + Spacing;
+
+    m_tree = wlr_scene_tree_create(&m_server->xdgShell->getScene()->handle()->tree);
+    wlr_scene_node_set_position(&m_tree->node, box.x() + (box.width() - width) / 2,
+                                box.y() + qMax(0, (box.height() - height) / 2));
+
+    static const float background[4] = { 0.1f, 0.1f, 0.1f, 0.85f };
+    static const float highlight[4] = { 0.3f, 0.5f, 0.8f, 1.0f };
+    wlr_scene_rect_create(m_tree, width, height, background);
+    m_highlight = wlr_scene_rect_create(m_tree, CellWidth + Spacing, CellHeight + Spacing, highlight);
+
+    for (int i = 0; i < count; ++i) {
+        Thumbnail &thumbnail = m_thumbnails[m_order.at(i)];
+        if (thumbnail.page < 0)
+            continue;
+        const wlr_box cell = cellBox(thumbnail.cell);
+        const wlr_fbox source { double(cell.x), double(cell.y), double(cell.width), double(cell.height) };
+        thumbnail.node = wlr_scene_buffer_create(m_tree, m_pages.at(thumbnail.page).buffer);
+        wlr_scene_buffer_set_source_box(thumbnail.node, &source);
+        wlr_scene_buffer_set_dest_size(thumbnail.node, CellWidth, CellHeight);
+        wlr_scene_node_set_position(&thumbnail.node->node,
+                                    Spacing + (i % columns) * (CellWidth + Spacing),
+                                    Spacing + (i / columns) * (CellHeight + Spacing));
+    }
+}
+
+void QBoxSwitcher::commit()
+{
+    if (!isActive())
+        return;
+    View *view = m_order.value(m_selected);
+    close();
+    if (view)
+        m_server->xdgShell->focusView(view, view->surface());
+}
+
+void QBoxSwitcher::cancel()
+{
+    if (isActive())
+        close();
+}
+
+void QBoxSwitcher::close()
+{
+    wlr_scene_node_destroy(&m_tree->node);
+    m_tree = nullptr;
+    m_highlight = nullptr;
+    for (View *view : std::as_const(m_order)) {
+        auto it = m_thumbnails.find(view);
+        if (it != m_thumbnails.end())
+            it->node = nullptr;
+    }
+    m_order.clear();
+    m_refreshTimer->stop();
+}
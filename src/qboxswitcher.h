@@ -0,0 +1,81 @@
+#ifndef QBOXSWITCHER_H
+#define QBOXSWITCHER_H
+
+#include "qboxoutput.h"
+
+#include <QObject>
+#include <QHash>
+#include <QList>
+
+QT_BEGIN_NAMESPACE
+class QTimer;
+QT_END_NAMESPACE
+
+struct wlr_buffer;
+struct wlr_scene_tree;
+struct wlr_scene_rect;
+struct wlr_scene_buffer;
+
+class QBoxServer;
+
+/* Alt-tab style window switcher.
+ *
+ * Thumbnails are downscaled copies of each view kept in fixed size cells
+ * of shared atlas pages. A view's cell is only redrawn after it committed
+ * new content, and while the switcher is open at most ThumbnailRate times
+ * a second, so opening it over many windows draws a handful of small
+ * quads instead of every surface at full size. */
+class QBoxSwitcher : public QObject
+{
+    Q_OBJECT
+    using View = QBoxOutPut::View;
+public:
+    explicit QBoxSwitcher(QBoxServer *server);
+    ~QBoxSwitcher();
+
+    bool isActive() const {
+        return m_tree;
+    }
+    /* Opens the switcher if needed and moves the selection. */
+    void step(int direction);
+    void commit();
+    void cancel();
+
+private:
+    struct Page
+    {
+        wlr_buffer *buffer;
+        QList<bool> used;
+    };
+    struct Thumbnail
+    {
+        int page = -1;
+        int cell = -1;
+        bool dirty = true;
+        wlr_scene_buffer *node = nullptr;
+        QMetaObject::Connection commit;
+    };
+
+    void onViewMapped(View *view);
+    void onViewUnmapped(View *view);
+    bool allocateCell(Thumbnail *thumbnail);
+    void renderDirty();
+    void renderPage(int page, const QList<View*> &views);
+    void layout();
+    void close();
+
+    QList<Page> m_pages;
+    QHash<View*, Thumbnail> m_thumbnails;
+    QTimer *m_refreshTimer;
+
+    /* Only while open. */
+    wlr_scene_tree *m_tree = nullptr;
+    wlr_scene_rect *m_highlight = nullptr;
+    QList<View*> m_order;
+    int m_selected = 0;
+    int m_columns = 1;
+
+    QBoxServer *m_server;
+};
+
+#endif // QBOXSWITCHER_H
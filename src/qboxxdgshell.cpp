@@ -6,14 +6,75 @@
 #include <qwoutput.h>
 #include <qwxdgshell.h>
 
+#include <QTimer>
+
+extern "C" {
+#include <wlr/config.h>
+#include <wlr/types/wlr_output_layout.h>
+#include <wlr/types/wlr_scene.h>
+#if WLR_HAS_XWAYLAND
+/* wlr_xwayland_surface has a member called class. */
+#define class class_
+#include <wlr/xwayland.h>
+#undef class
+#endif
+}
+
+/* A client that doesn't answer a resize in time is shown as it is. */
+static constexpr int SnapshotTimeout = 1000; // ms
+
+namespace {
+struct SceneUsage
+{
+    int trees = 0;
+    int rects = 0;
+    int buffers = 0;
+    qint64 nodeBytes = 0;
+    /* Mostly client buffers, which the clients are accounted for too. */
+    qint64 bufferBytes = 0;
+};
+}
+
+static void sceneUsage(wlr_scene_tree *tree, SceneUsage *usage)
+{
+    ++usage->trees;
+    usage->nodeBytes += sizeof(wlr_scene_tree);
+    wlr_scene_node *node;
+    wl_list_for_each(node, &tree->children, link) {
+        switch (node->type) {
+        case WLR_SCENE_NODE_TREE:
+            sceneUsage(wlr_scene_tree_from_node(node), usage);
+            break;
+        case WLR_SCENE_NODE_RECT:
+            ++usage->rects;
+            usage->nodeBytes += sizeof(wlr_scene_rect);
+            break;
+        case WLR_SCENE_NODE_BUFFER: {
+            wlr_scene_buffer *buffer = wlr_scene_buffer_from_node(node);
+            ++usage->buffers;
+            usage->nodeBytes += sizeof(wlr_scene_buffer);
+            if (buffer->buffer)
+                usage->bufferBytes += qint64(buffer->buffer->width) * buffer->buffer->height * 4;
+            break;
+        }
+        }
+    }
+}
+
 QBoxXdgShell::QBoxXdgShell(QBoxServer *server):
     m_server(server),
     QObject(server)
 {
     scene = new QWScene(server);
     scene->attachOutputLayout(m_server->output->outputLayout);
-    xdgShell = QWXdgShell::create(server->display, 3);
+    xdgShell = QWXdgShell::create(server->display, 4);
     connect(xdgShell, &QWXdgShell::newSurface, this, &QBoxXdgShell::onNewXdgSurface);
+
+    /* Focus and fullscreen decide where adaptive sync is wanted. */
+    connect(this, &QBoxXdgShell::viewFocused, server->output, &QBoxOutPut::onViewStateChanged);
+    connect(this, &QBoxXdgShell::viewUnmapped, server->output, &QBoxOutPut::onViewStateChanged);
+    connect(this, &QBoxXdgShell::viewFullscreenChanged, server->output, &QBoxOutPut::onViewStateChanged);
+    connect(this, &QBoxXdgShell::focusedViewCommitted, server->output, &QBoxOutPut::onFocusedViewCommitted);
 }
 
 void QBoxXdgShell::focusView(View *view, wlr_surface *surface)
@@ -33,10 +94,12 @@ void QBoxXdgShell::focusView(View *view, wlr_surface *surface)
          * it no longer has focus and the client will repaint accordingly, e.g.
          * stop displaying a caret.
          */
-        auto previous = QWXdgSurface::from(QWSurface::from(prevSurface));
-        auto toplevel = qobject_cast<QWXdgToplevel*>(previous);
-        Q_ASSERT(toplevel);
-        toplevel->setActivated(false);
+        for (View *previous : std::as_const(m_server->views)) {
+            if (previous->surface() == prevSurface) {
+                previous->setActivated(false);
+                break;
+            }
+        }
     }
 
     /* Move the view to the front */
@@ -45,7 +108,7 @@ void QBoxXdgShell::focusView(View *view, wlr_surface *surface)
 //   }
     m_server->views.move(m_server->views.indexOf(view), 0);
     /* Activate the new surface */
-    view->xdgToplevel->setActivated(true);
+    view->setActivated(true);
 
     /*
      * Tell the seat to have the keyboard enter this surface. wlroots will keep
@@ -53,16 +116,16 @@ void QBoxXdgShell::focusView(View *view, wlr_surface *surface)
      * clients without additional work on your part.
      */
     if (QWKeyboard *keyboard = seat->getKeyboard()) {
-        seat->keyboardNotifyEnter(QWSurface::from(view->xdgToplevel->handle()->base->surface),
+        seat->keyboardNotifyEnter(QWSurface::from(view->surface()),
                                        keyboard->handle()->keycodes, keyboard->handle()->num_keycodes, &keyboard->handle()->modifiers);
     }
+
+    Q_EMIT viewFocused(view);
 }
 
 QWOutput *QBoxXdgShell::getActiveOutput(View *view)
 {
-    const QPointF center_p = view->geometry.toRectF().center();
-    QPointF closest_p = m_server->output->outputLayout->closestPoint(nullptr, center_p);
-    return m_server->output->outputLayout->outputAt(closest_p);
+    return m_server->output->outputAt(view->geometry.toRectF().center());
 }
 
 QBoxXdgShell::View *QBoxXdgShell::viewAt(const QPointF &pos, wlr_surface **surface, QPointF *spos) const
@@ -94,6 +157,15 @@ QBoxXdgShell::View *QBoxXdgShell::viewAt(const QPointF &pos, wlr_surface **surfa
     return tree ? reinterpret_cast<View*>(tree->node.data) : nullptr;
 }
 
+QBoxXdgShell::View *QBoxXdgShell::findView(uint32_t id) const
+{
+    for (View *view : std::as_const(m_server->views)) {
+        if (view->id == id)
+            return view;
+    }
+    return nullptr;
+}
+
 void QBoxXdgShell::onNewXdgSurface(wlr_xdg_surface *surface)
 {
     /* This event is raised when wlr_xdg_shell receives a new xdg surface from a
@@ -117,6 +189,7 @@ void QBoxXdgShell::onNewXdgSurface(wlr_xdg_surface *surface)
     /* Allocate a View for this surface */
     auto view = new View();
     view->server = m_server;
+    view->id = m_nextViewId++;
     auto s = QWXdgToplevel::from(surface->toplevel);
     view->xdgToplevel = s;
     view->sceneTree = QWScene::xdgSurfaceCreate(scene, s);
@@ -125,6 +198,20 @@ void QBoxXdgShell::onNewXdgSurface(wlr_xdg_surface *surface)
     /* Listen to the various events it can emit */
     connect(s->surface(), &QWSurface::map, this, &QBoxXdgShell::onMap);
     connect(s->surface(), &QWSurface::unmap, this, &QBoxXdgShell::onUnmap);
+    connect(s->surface(), &QWSurface::commit, this, [this, view] {
+        if (!view->initialConfigured) {
+            onInitialCommit(view);
+            return;
+        }
+        auto snapshot = m_snapshots.constFind(view);
+        if (snapshot != m_snapshots.constEnd() && snapshot->configured
+                && int32_t(view->xdgToplevel->handle()->base->current.configure_serial - snapshot->serial) >= 0) {
+            /* This buffer was drawn for the resize, show the real thing. */
+            dropSnapshot(view);
+        }
+        if (!m_server->views.isEmpty() && m_server->views.first() == view)
+            Q_EMIT focusedViewCommitted(view);
+    });
     connect(s->toPopup(), &QWXdgPopup::newPopup, this, &QBoxXdgShell::onXdgToplevelNewPopup);
     connect(s, &QWXdgToplevel::requestMove, this, &QBoxXdgShell::onXdgToplevelRequestMove);
     connect(s, &QWXdgToplevel::requestResize, this, &QBoxXdgShell::onXdgToplevelRequestResize);
@@ -132,13 +219,96 @@ void QBoxXdgShell::onNewXdgSurface(wlr_xdg_surface *surface)
     connect(s, &QWXdgToplevel::requestMinimize, this, &QBoxXdgShell::onXdgToplevelRequestMinimize);
     connect(s, &QWXdgToplevel::requestFullscreen, this, &QBoxXdgShell::onXdgToplevelRequestRequestFullscreen);
     connect(s, &QWXdgToplevel::destroyed, this, [this, view] {
-        m_server->views.removeOne(view);
-        if (m_server->grabbedView == view)
-            m_server->grabbedView = nullptr;
-        delete view;
+        destroyView(view);
     });
 }
 
+void QBoxXdgShell::mapView(View *view, bool focus)
+{
+    m_server->views.append(view); // ?
+    if (focus)
+        focusView(view, view->surface());
+    view->sceneTree->setPosition(view->geometry.topLeft());
+
+    Q_EMIT viewMapped(view);
+}
+
+void QBoxXdgShell::unmapView(View *view)
+{
+    qsizetype viewid = m_server->views.indexOf(view);
+    if (viewid < 0)
+        return;
+    m_server->views.removeAt(viewid);
+    if (m_server->grabbedView == view) {
+        m_server->grabbedView = nullptr;
+        m_server->cursor->setCursorState(QBoxCursor::CursorState::Normal);
+    }
+
+    Q_EMIT viewUnmapped(view);
+
+    /* Focus the next view, if any. */
+    if (viewid >= m_server->views.size())
+        return;
+    auto *nextView = m_server->views.at(viewid);
+    if (nextView && nextView->sceneTree && nextView->sceneTree->handle()->node.enabled) {
+        wlr_log(WLR_INFO, "%s: %s", "Focusing next view", nextView->appId().constData());
+        focusView(nextView, nextView->surface());
+    }
+}
+
+void QBoxXdgShell::destroyView(View *view)
+{
+    m_server->views.removeOne(view);
+    if (m_server->grabbedView == view)
+        m_server->grabbedView = nullptr;
+    delete view;
+}
+
+void QBoxXdgShell::onInitialCommit(View *view)
+{
+    /* The first commit of a toplevel carries no buffer, it asks for the
+     * initial configure. Decide where the window goes and what state it is
+     * in now, so that its first frame is already drawn at the final size
+     * instead of being resized again once mapped. */
+    view->initialConfigured = true;
+    auto *toplevel = view->xdgToplevel->handle();
+    /* Server-side decorations take space out of the usable area. */
+    m_server->decoration->applyMode(view);
+
+    /* Whatever the placement, new windows open on the output with the
+     * cursor. The position itself is only known once the client has chosen
+     * its size. */
+    view->geometry = QRect();
+    view->geometry.moveCenter(m_server->cursor->getCursor()->position().toPoint());
+    const QRect usableArea = getUsableArea(view);
+    /* What leaving an initial fullscreen or maximized state goes back to,
+     * there is no size of the client's own to restore yet. */
+    view->previous_geometry = QRect(QPoint(), usableArea.size() / 2);
+    view->previous_geometry.moveCenter(usableArea.center());
+
+    if (toplevel->requested.fullscreen) {
+        if (QWOutput *output = getActiveOutput(view)) {
+            view->geometry = m_server->output->layoutBox(output);
+            view->fullscreen = true;
+            view->xdgToplevel->setSize(view->geometry.size());
+            view->xdgToplevel->setFullscreen(true);
+            return;
+        }
+    }
+    if (toplevel->requested.maximized) {
+        view->geometry = usableArea;
+        view->xdgToplevel->setSize(view->geometry.size());
+        view->xdgToplevel->setMaximized(true);
+        return;
+    }
+
+    /* Let the client pick its size, but within the usable area so that we
+     * never have to shrink it after the fact. */
+    if (wl_resource_get_version(toplevel->resource) >= XDG_TOPLEVEL_CONFIGURE_BOUNDS_SINCE_VERSION)
+        wlr_xdg_toplevel_set_bounds(toplevel, usableArea.width(), usableArea.height());
+    view->xdgToplevel->scheduleConfigure();
+}
+
 void QBoxXdgShell::onMap()
 {
     /* Called when the surface is mapped, or ready to display on-screen. */
@@ -149,28 +319,47 @@ void QBoxXdgShell::onMap()
     Q_ASSERT(view);
     if (view->xdgToplevel->handle()->base->role != WLR_XDG_SURFACE_ROLE_TOPLEVEL)
         return;
-    auto geoBox = view->xdgToplevel->getGeometry();
-    auto usableArea = getUsableArea(view);
-
-    /*
-     * TODO: config geometry
-     */
-    view->geometry = {
-      0, // x
-      0, // y
-      std::min(geoBox.width(), usableArea.width()), // width
-      std::min(geoBox.height(), usableArea.height()) // height
-    };
-
-    m_server->views.append(view); // ?
-
-    /* A view no larger than a title bar shouldn't be sized or focused */
-    if (view->geometry.height() > TITLEBAR_HEIGHT &&
-            view->geometry.height() > TITLEBAR_HEIGHT * (usableArea.width()/usableArea.height())) {
-        view->xdgToplevel->setSize(view->geometry.size());
-        focusView(view, surface->handle()->surface);
+    auto *toplevel = view->xdgToplevel->handle();
+    auto config = m_server->config->current();
+    const int titlebarHeight = config->general.titlebarHeight;
+
+    /* Fullscreen and maximized views were laid out by the initial configure. */
+    if (!view->fullscreen && !toplevel->current.maximized) {
+        auto geoBox = view->xdgToplevel->getGeometry();
+        auto usableArea = getUsableArea(view);
+        view->geometry = {
+          0, // x
+          0, // y
+          std::min(geoBox.width(), usableArea.width()), // width
+          std::min(geoBox.height(), usableArea.height()) // height
+        };
+
+        switch (config->general.placement) {
+        case QBoxConfig::Placement::Origin:
+            view->geometry.moveTopLeft(usableArea.topLeft());
+            break;
+        case QBoxConfig::Placement::Center:
+            view->geometry.moveCenter(usableArea.center());
+            break;
+        case QBoxConfig::Placement::Cursor:
+            view->geometry.moveCenter(m_server->cursor->getCursor()->position().toPoint());
+            break;
+        }
+        /* Keep the top left corner reachable. */
+        view->geometry.moveLeft(std::clamp(view->geometry.left(), usableArea.left(),
+                                           std::max(usableArea.left(), usableArea.right() - view->geometry.width())));
+        view->geometry.moveTop(std::clamp(view->geometry.top(), usableArea.top(),
+                                          std::max(usableArea.top(), usableArea.bottom() - view->geometry.height())));
+
+        /* Only clients that ignored the configure bounds get resized. */
+        if (view->geometry.size() != geoBox.size())
+            view->xdgToplevel->setSize(view->geometry.size());
     }
-    view->sceneTree->setPosition(view->geometry.topLeft());
+
+    /* A view no larger than a title bar shouldn't be focused */
+    const QRect usableArea = getUsableArea(view);
+    mapView(view, !usableArea.isEmpty() && view->geometry.height() > titlebarHeight &&
+            view->geometry.height() > titlebarHeight * (usableArea.width()/usableArea.height()));
 }
 
 void QBoxXdgShell::onUnmap()
@@ -183,18 +372,10 @@ void QBoxXdgShell::onUnmap()
     if (view->xdgToplevel->handle()->base->role != WLR_XDG_SURFACE_ROLE_TOPLEVEL)
         return;
 
-    qsizetype viewid = m_server->views.indexOf(view);
-    m_server->views.removeAt(viewid);
-
-    /* Focus the next view, if any. */
-    if (viewid >= m_server->views.size())
-        return;
-    auto *nextView = m_server->views.at(viewid);
-    if (nextView && nextView->sceneTree && nextView->sceneTree->handle()->node.enabled) {
-        wlr_log(WLR_INFO, "%s: %s", "Focusing next view",
-            nextView->xdgToplevel->handle()->app_id);
-         focusView(nextView, nextView->xdgToplevel->handle()->base->surface);
-    }
+    /* A toplevel that maps again starts over with a new initial commit. */
+    view->initialConfigured = false;
+    dropSnapshot(view);
+    unmapView(view);
 }
 
 void QBoxXdgShell::onXdgToplevelNewPopup(QWXdgPopup *popup)
@@ -203,16 +384,14 @@ void QBoxXdgShell::onXdgToplevelNewPopup(QWXdgPopup *popup)
     auto view = getView(surface);
     Q_ASSERT(view);
     QPointF outputPos = view->geometry.topLeft() + popup->getGeometry().topLeft();
-    auto *woutput = m_server->output->outputLayout->outputAt(outputPos); // TODO
-
-    if (!woutput) {
+    QWOutput *output = m_server->output->outputAt(outputPos);
+    if (!output) {
         return;
     }
-    auto *qoutput = reinterpret_cast<QBoxOutPut*>(woutput->handle()->data);
 
     int topMargin = 0; // TODO: read from config
 
-    QRect outputToplevelBox = qoutput->geometry;
+    QRect outputToplevelBox = m_server->output->layoutBox(output);
     outputToplevelBox.moveTopLeft(outputToplevelBox.topLeft() - view->geometry.topLeft());
     outputToplevelBox.setHeight(outputToplevelBox.height() - topMargin);
     popup->unconstrainFromBox(outputToplevelBox);
@@ -227,7 +406,8 @@ void QBoxXdgShell::onXdgToplevelRequestMove(wlr_xdg_toplevel_move_event *)
     auto surface = qobject_cast<QWXdgSurface*>(sender());
     auto view = getView(surface);
     Q_ASSERT(view);
-    beginInteractive(view, QBoxCursor::CursorState::MovingWindow, 0);
+    if (hasPointerFocus(view))
+        beginInteractive(view, QBoxCursor::CursorState::MovingWindow, 0);
 }
 
 void QBoxXdgShell::onXdgToplevelRequestResize(wlr_xdg_toplevel_resize_event *event)
@@ -238,15 +418,16 @@ void QBoxXdgShell::onXdgToplevelRequestResize(wlr_xdg_toplevel_resize_event *eve
     auto surface = qobject_cast<QWXdgSurface*>(sender());
     auto view = getView(surface);
     Q_ASSERT(view);
-    beginInteractive(view, QBoxCursor::CursorState::ResizingWindow, event->edges);
+    if (hasPointerFocus(view))
+        beginInteractive(view, QBoxCursor::CursorState::ResizingWindow, event->edges);
 }
 
 QRect QBoxXdgShell::getUsableArea(View *view)
 {
-    QRect usable_area{0, 0, 0, 0};
     QWOutput *output = getActiveOutput(view);
-    usable_area.setSize(output->effectiveResolution());
-    return usable_area;
+    if (!output)
+        return QRect();
+    return m_server->output->usableArea(output).marginsRemoved(m_server->decoration->margins(view));
 }
 
 void QBoxXdgShell::onXdgToplevelRequestMaximize(bool maximize)
@@ -258,24 +439,23 @@ void QBoxXdgShell::onXdgToplevelRequestMaximize(bool maximize)
     auto surface = qobject_cast<QWXdgSurface*>(sender());
     auto view = getView(surface);
 
-    QRect usable_area = getUsableArea(view);
-
     bool is_maximized = view->xdgToplevel->handle()->current.maximized;
     if (!is_maximized) {
          view->previous_geometry = view->geometry;
          // FIXME: should not set this
          view->previous_geometry.setWidth(view->xdgToplevel->handle()->current.width);
          view->previous_geometry.setHeight(view->xdgToplevel->handle()->current.height);
-         view->geometry.setX(0);
-         view->geometry.setY(0);
+         /* The whole rect, everything reading the cached geometry goes
+          * by its center. */
+         view->geometry = getUsableArea(view);
     } else {
-         usable_area = view->previous_geometry;
-         view->geometry.setTopLeft(view->previous_geometry.topLeft());
+         view->geometry = view->previous_geometry;
     }
 
-    view->xdgToplevel->setSize(usable_area.size());
+    view->xdgToplevel->setSize(view->geometry.size());
     view->xdgToplevel->setMaximized(!is_maximized);
     view->sceneTree->setPosition(view->geometry.topLeft());
+    Q_EMIT viewMoved(view);
 //    surface->scheduleConfigure();
 }
 
@@ -305,18 +485,188 @@ void QBoxXdgShell::onXdgToplevelRequestMinimize(bool minimize)
     }
 
     view->sceneTree->setPosition(view->geometry.topLeft());
+    Q_EMIT viewMoved(view);
 }
 
-void QBoxXdgShell::onXdgToplevelRequestRequestFullscreen(bool fullscreen) // TODO
+void QBoxXdgShell::onXdgToplevelRequestRequestFullscreen(bool fullscreen)
 {
     /* This event is raised when a client would like to set itself to
-     * fullscreen. qwlbox currently doesn't support fullscreen, but to
-     * conform to xdg-shell protocol we still must send a configure.
-     * wlr_xdg_surface_schedule_configure() is used to send an empty reply.
-     */
+     * fullscreen. The view covers the whole output it is on, on top of
+     * everything else. */
     Q_UNUSED(fullscreen);
     auto surface = qobject_cast<QWXdgSurface*>(sender());
-    surface->scheduleConfigure();
+    auto view = getView(surface);
+    setFullscreen(view, view->xdgToplevel->handle()->requested.fullscreen);
+}
+
+void QBoxXdgShell::setFullscreen(View *view, bool fullscreen)
+{
+    if (view->fullscreen == fullscreen || !m_server->views.contains(view)) {
+        /* To conform to xdg-shell protocol we still must send a configure. */
+        if (view->xdgToplevel)
+            view->xdgToplevel->scheduleConfigure();
+        return;
+    }
+
+    if (fullscreen) {
+        QWOutput *output = getActiveOutput(view);
+        if (!output)
+            return;
+        view->previous_geometry = view->geometry;
+        view->geometry = m_server->output->layoutBox(output);
+        view->sceneTree->raiseToTop();
+    } else {
+        view->geometry = view->previous_geometry;
+    }
+
+    view->fullscreen = fullscreen;
+    view->setSize(view->geometry.size());
+    view->setFullscreenState(fullscreen);
+    view->sceneTree->setPosition(view->geometry.topLeft());
+
+    Q_EMIT viewFullscreenChanged(view);
+}
+
+void QBoxXdgShell::resizeView(View *view, const QSize &size)
+{
+    view->sceneTree->setPosition(view->geometry.topLeft());
+    Q_EMIT viewMoved(view);
+    auto config = m_server->config->current();
+    if (!view->xdgToplevel || !config->general.resizeSnapshot) {
+        view->setSize(size);
+        return;
+    }
+
+    if (!m_snapshots.contains(view) && !takeSnapshot(view)) {
+        view->setSize(size);
+        return;
+    }
+    ResizeSnapshot &snapshot = m_snapshots[view];
+    const uint32_t serial = wlr_xdg_toplevel_set_size(view->xdgToplevel->handle(), size.width(), size.height());
+    if (!snapshot.configured) {
+        snapshot.configured = true;
+        snapshot.serial = serial;
+    }
+    snapshot.timeout->start();
+
+    /* Stretched around the window geometry origin, which the view tree
+     * position is. */
+    const qreal sx = qreal(size.width()) / snapshot.size.width();
+    const qreal sy = qreal(size.height()) / snapshot.size.height();
+    for (const ResizeSnapshot::Buffer &buffer : std::as_const(snapshot.buffers)) {
+        const int x = qRound(buffer.box.x() * sx);
+        const int y = qRound(buffer.box.y() * sy);
+        wlr_scene_node_set_position(&buffer.node->node, x, y);
+        wlr_scene_buffer_set_dest_size(buffer.node,
+                                       qMax(1, qRound((buffer.box.x() + buffer.box.width()) * sx) - x),
+                                       qMax(1, qRound((buffer.box.y() + buffer.box.height()) * sy) - y));
+    }
+}
+
+void QBoxXdgShell::appendMemoryStatistics(QByteArray *out) const
+{
+    const qsizetype views = m_server->views.size();
+    *out += "memory.views.mapped=" + QByteArray::number(views) + '\n';
+    *out += "memory.views.mapped_bytes=" + QByteArray::number(qulonglong(views * sizeof(View))) + '\n';
+
+    int snapshotBuffers = 0;
+    for (const ResizeSnapshot &snapshot : std::as_const(m_snapshots))
+        snapshotBuffers += snapshot.buffers.size();
+    *out += "memory.snapshots=" + QByteArray::number(m_snapshots.size()) + '\n';
+    *out += "memory.snapshots.buffers=" + QByteArray::number(snapshotBuffers) + '\n';
+
+    SceneUsage usage;
+    sceneUsage(&scene->handle()->tree, &usage);
+    *out += "memory.scene.trees=" + QByteArray::number(usage.trees) + '\n';
+    *out += "memory.scene.rects=" + QByteArray::number(usage.rects) + '\n';
+    *out += "memory.scene.buffers=" + QByteArray::number(usage.buffers) + '\n';
+    *out += "memory.scene.node_bytes=" + QByteArray::number(usage.nodeBytes) + '\n';
+    *out += "memory.scene.buffer_bytes=" + QByteArray::number(usage.bufferBytes) + '\n';
+}
+
+bool QBoxXdgShell::takeSnapshot(View *view)
+{
+    const QSize size = view->windowGeometry().size();
+    if (size.isEmpty())
+        return false;
+
+    struct Capture
+    {
+        wlr_surface *root;
+        wlr_scene_node *live = nullptr;
+        QList<std::pair<wlr_scene_buffer*, QPoint>> buffers;
+    } capture;
+    capture.root = view->surface();
+    wlr_scene_node *viewNode = &view->sceneTree->handle()->node;
+    /* Coordinates include the position of the view node itself. */
+    wlr_scene_node_for_each_buffer(viewNode, [](wlr_scene_buffer *buffer, int sx, int sy, void *data) {
+        auto *capture = static_cast<Capture*>(data);
+#if WLR_VERSION_MINOR > 16
+        wlr_scene_surface *sceneSurface = wlr_scene_surface_try_from_buffer(buffer);
+#else
+        wlr_scene_surface *sceneSurface = wlr_scene_surface_from_buffer(buffer);
+#endif
+        if (!sceneSurface || !buffer->buffer)
+            return;
+        if (sceneSurface->surface == capture->root)
+            capture->live = &buffer->node.parent->node;
+        capture->buffers.append({ buffer, QPoint(sx, sy) });
+    }, &capture);
+    if (!capture.live)
+        return false;
+
+    ResizeSnapshot snapshot;
+    snapshot.size = size;
+    snapshot.live = capture.live;
+    snapshot.tree = wlr_scene_tree_create(view->sceneTree->handle());
+    wlr_scene_node_place_above(&snapshot.tree->node, capture.live);
+    for (const auto &[buffer, pos] : std::as_const(capture.buffers)) {
+        /* Popups have trees of their own and stay live. */
+        wlr_scene_tree *tree = buffer->node.parent;
+        while (tree && &tree->node != capture.live)
+            tree = tree->node.parent;
+        if (!tree)
+            continue;
+        /* Holds a lock, the client won't get the buffer back meanwhile. */
+        wlr_scene_buffer *copy = wlr_scene_buffer_create(snapshot.tree, buffer->buffer);
+        wlr_scene_buffer_set_source_box(copy, &buffer->src_box);
+        wlr_scene_buffer_set_transform(copy, buffer->transform);
+        const QRect box(pos - QPoint(viewNode->x, viewNode->y),
+                        QSize(buffer->dst_width ? buffer->dst_width : buffer->buffer->width,
+                              buffer->dst_height ? buffer->dst_height : buffer->buffer->height));
+        wlr_scene_node_set_position(&copy->node, box.x(), box.y());
+        wlr_scene_buffer_set_dest_size(copy, box.width(), box.height());
+        snapshot.buffers.append({ copy, box });
+    }
+    wlr_scene_node_set_enabled(capture.live, false);
+
+    snapshot.timeout = new QTimer(this);
+    snapshot.timeout->setSingleShot(true);
+    snapshot.timeout->setInterval(SnapshotTimeout);
+    connect(snapshot.timeout, &QTimer::timeout, this, [this, view] {
+        dropSnapshot(view);
+    });
+    m_snapshots.insert(view, snapshot);
+    return true;
+}
+
+void QBoxXdgShell::dropSnapshot(View *view)
+{
+    auto it = m_snapshots.find(view);
+    if (it == m_snapshots.end())
+        return;
+    wlr_scene_node_destroy(&it->tree->node);
+    wlr_scene_node_set_enabled(it->live, true);
+    it->timeout->deleteLater();
+    m_snapshots.erase(it);
+}
+
+bool QBoxXdgShell::hasPointerFocus(View *view) const
+{
+    /* Move/resize requests from unfocused clients are denied. */
+    wlr_surface *focusedSurface = m_server->seat->m_seat->handle()->pointer_state.focused_surface;
+    return focusedSurface && view->surface() ==
+            wlr_surface_get_root_surface(focusedSurface);
 }
 
 void QBoxXdgShell::beginInteractive(View *view, QBoxCursor::CursorState state, uint32_t edges)
@@ -324,18 +674,11 @@ void QBoxXdgShell::beginInteractive(View *view, QBoxCursor::CursorState state, u
     /* This function sets up an interactive move or resize operation, where the
      * compositor stops propagating pointer events to clients and instead
      * consumes them itself, to move or resize windows. */
-    wlr_surface *focusedSurface = m_server->seat->m_seat->handle()->pointer_state.focused_surface;
-
-    /* Deny move/resize requests from unfocused clients. */
-    if (view->xdgToplevel->handle()->base->surface !=
-            wlr_surface_get_root_surface(focusedSurface)) {
-        return;
-    }
     m_server->grabbedView = view;
     m_server->cursor->setCursorState(state);
 
     m_server->grabCursorPos = m_server->cursor->getCursor()->position();
-    m_server->grabGeoBox = view->xdgToplevel->getGeometry();
+    m_server->grabGeoBox = view->windowGeometry();
     m_server->grabGeoBox.moveTopLeft(view->geometry.topLeft() + m_server->grabGeoBox.topLeft());
     m_server->resizingEdges = edges;
 }
@@ -345,3 +688,131 @@ QBoxXdgShell::View *QBoxXdgShell::getView(const QWXdgSurface *surface)
     auto sceneTree = reinterpret_cast<QWSceneTree*>(surface->handle()->data);
     return reinterpret_cast<View*>(sceneTree->handle()->node.data);
 }
+
+wlr_surface *QBoxOutPut::View::surface() const
+{
+#if WLR_HAS_XWAYLAND
+    if (xwaylandSurface)
+        return xwaylandSurface->surface;
+#endif
+    return xdgToplevel->handle()->base->surface;
+}
+
+QByteArray QBoxOutPut::View::appId() const
+{
+#if WLR_HAS_XWAYLAND
+    if (xwaylandSurface)
+        return QByteArray(xwaylandSurface->class_);
+#endif
+    return QByteArray(xdgToplevel->handle()->app_id);
+}
+
+QByteArray QBoxOutPut::View::title() const
+{
+#if WLR_HAS_XWAYLAND
+    if (xwaylandSurface)
+        return QByteArray(xwaylandSurface->title);
+#endif
+    return QByteArray(xdgToplevel->handle()->title);
+}
+
+QRect QBoxOutPut::View::windowGeometry() const
+{
+#if WLR_HAS_XWAYLAND
+    if (xwaylandSurface)
+        return QRect(0, 0, xwaylandSurface->width, xwaylandSurface->height);
+#endif
+    return xdgToplevel->getGeometry();
+}
+
+QSize QBoxOutPut::View::minSize() const
+{
+#if WLR_HAS_XWAYLAND
+    if (xwaylandSurface) {
+        auto *hints = xwaylandSurface->size_hints;
+        return hints ? QSize(qMax(0, hints->min_width), qMax(0, hints->min_height)) : QSize(0, 0);
+    }
+#endif
+    return QSize(xdgToplevel->handle()->current.min_width, xdgToplevel->handle()->current.min_height);
+}
+
+QSize QBoxOutPut::View::maxSize() const
+{
+    /* 0 for unlimited, as in xdg-shell. */
+#if WLR_HAS_XWAYLAND
+    if (xwaylandSurface) {
+        auto *hints = xwaylandSurface->size_hints;
+        return hints ? QSize(qMax(0, hints->max_width), qMax(0, hints->max_height)) : QSize(0, 0);
+    }
+#endif
+    return QSize(xdgToplevel->handle()->current.max_width, xdgToplevel->handle()->current.max_height);
+}
+
+void QBoxOutPut::View::setSize(const QSize &size)
+{
+#if WLR_HAS_XWAYLAND
+    if (xwaylandSurface) {
+        wlr_xwayland_surface_configure(xwaylandSurface, geometry.x(), geometry.y(),
+                                       size.width(), size.height());
+        return;
+    }
+#endif
+    xdgToplevel->setSize(size);
+}
+
+void QBoxOutPut::View::syncPosition()
+{
+#if WLR_HAS_XWAYLAND
+    if (xwaylandSurface) {
+        wlr_xwayland_surface_configure(xwaylandSurface, geometry.x(), geometry.y(),
+                                       xwaylandSurface->width, xwaylandSurface->height);
+    }
+#endif
+}
+
+void QBoxOutPut::View::setActivated(bool activated)
+{
+#if WLR_HAS_XWAYLAND
+    if (xwaylandSurface) {
+        wlr_xwayland_surface_activate(xwaylandSurface, activated);
+        if (activated)
+            wlr_xwayland_surface_restack(xwaylandSurface, nullptr, XCB_STACK_MODE_ABOVE);
+        return;
+    }
+#endif
+    xdgToplevel->setActivated(activated);
+}
+
+void QBoxOutPut::View::setFullscreenState(bool fullscreen)
+{
+#if WLR_HAS_XWAYLAND
+    if (xwaylandSurface) {
+        wlr_xwayland_surface_set_fullscreen(xwaylandSurface, fullscreen);
+        return;
+    }
+#endif
+    xdgToplevel->setFullscreen(fullscreen);
+}
+
+void QBoxOutPut::View::close()
+{
+#if WLR_HAS_XWAYLAND
+    if (xwaylandSurface) {
+        wlr_xwayland_surface_close(xwaylandSurface);
+        return;
+    }
+#endif
+    wlr_xdg_toplevel_send_close(xdgToplevel->handle());
+}
+
+void QBoxOutPut::View::forEachSurface(void (*iterator)(wlr_surface *surface, int sx, int sy, void *data),
+                                      void *data) const
+{
+#if WLR_HAS_XWAYLAND
+    if (xwaylandSurface) {
+        wlr_surface_for_each_surface(xwaylandSurface->surface, iterator, data);
+        return;
+    }
+#endif
+    wlr_xdg_surface_for_each_surface(xdgToplevel->handle()->base, iterator, data);
+}
@@ -6,6 +6,15 @@
 #include <qwscene.h>
 #include <qwxdgshell.h>
 #include <QObject>
+#include <QHash>
+
+QT_BEGIN_NAMESPACE
+class QTimer;
+QT_END_NAMESPACE
+
+struct wlr_scene_tree;
+struct wlr_scene_node;
+struct wlr_scene_buffer;
 
 using QW_NAMESPACE::QWScene, QW_NAMESPACE::QWXdgShell;
 using QW_NAMESPACE::QWXdgPopup, QW_NAMESPACE::QWXdgSurface;
@@ -18,6 +27,9 @@ class QBoxXdgShell : public QObject
     friend class QBoxDecoration;
     friend class QBoxCursor;
     friend class QBoxSeat;
+    friend class QBoxClientAccounting;
+    friend class QBoxXwayland;
+    friend class QBoxForeignToplevel;
 //    friend class QBoxOutPut;
     using View = QBoxOutPut::View;
 
@@ -27,9 +39,28 @@ public:
     void focusView(View *view, wlr_surface *surface);
     QWOutput *getActiveOutput(View *view);
     View *viewAt(const QPointF &pos, wlr_surface **surface, QPointF *spos) const;
+    View *findView(uint32_t id) const;
+    /* Shared with the other shells creating views. */
+    void mapView(View *view, bool focus);
+    void unmapView(View *view);
+    void destroyView(View *view);
+    /* One step of an interactive resize, the position is already updated. */
+    void resizeView(View *view, const QSize &size);
     QWScene *getScene() {
         return scene;
     }
+    /* Views, resize snapshots and the whole scene graph. */
+    void appendMemoryStatistics(QByteArray *out) const;
+
+Q_SIGNALS:
+    void viewMapped(View *view);
+    void viewUnmapped(View *view);
+    void viewFocused(View *view);
+    void viewFullscreenChanged(View *view);
+    /* Moved or resized after mapping, possibly onto another output. */
+    void viewMoved(View *view);
+    /* Only the focused view, which may be driving an adaptive sync output. */
+    void focusedViewCommitted(View *view);
 
 private Q_SLOTS:
     void onNewXdgSurface(wlr_xdg_surface *surface);
@@ -44,11 +75,38 @@ private Q_SLOTS:
 
 private:
     static inline View *getView(const QWXdgSurface *surface);
+    bool hasPointerFocus(View *view) const;
     void beginInteractive(View *view, QBoxCursor::CursorState state, uint32_t edges);
     QRect getUsableArea(View *view);
+    void setFullscreen(View *view, bool fullscreen);
+    void onInitialCommit(View *view);
+
+    /* The buffers a view showed when an interactive resize step began,
+     * stretched to the size asked for until the client commits a buffer
+     * for one of the configures sent since. */
+    struct ResizeSnapshot
+    {
+        struct Buffer
+        {
+            wlr_scene_buffer *node;
+            QRect box;
+        };
+        wlr_scene_tree *tree;
+        /* The surface tree of the view, hidden meanwhile. */
+        wlr_scene_node *live;
+        QSize size;
+        bool configured = false;
+        uint32_t serial = 0;
+        QTimer *timeout;
+        QList<Buffer> buffers;
+    };
+    bool takeSnapshot(View *view);
+    void dropSnapshot(View *view);
 
     QWScene *scene;
     QWXdgShell *xdgShell;
+    uint32_t m_nextViewId = 1;
+    QHash<View*, ResizeSnapshot> m_snapshots;
 
     QBoxServer *m_server;
 };
@@ -0,0 +1,269 @@
+#include "qboxxwayland.h"
+#include "qboxserver.h"
+#include "qwconfig.h"
+
+#include <cstdlib>
+
+extern "C" {
+#include <wlr/config.h>
+#if WLR_HAS_XWAYLAND
+#include <wlr/types/wlr_scene.h>
+#include <wlr/types/wlr_xcursor_manager.h>
+#include <wlr/xcursor.h>
+/* wlr_xwayland_surface has a member called class. */
+#define class class_
+#include <wlr/xwayland.h>
+#undef class
+#endif
+}
+
+QBoxXwayland::QBoxXwayland(QBoxServer *server):
+    m_server(server),
+    QObject(server)
+{
+    auto config = server->config->current();
+    if (!config->xwayland.enabled)
+        return;
+#if WLR_HAS_XWAYLAND
+    /* Lazy: nothing but the X11 sockets until a client connects. */
+#if WLR_VERSION_MINOR > 16
+    /* Both go away with the display, which also stops a running server. */
+    wlr_xwayland_server_options options {};
+    options.lazy = true;
+    options.enable_wm = true;
+    options.no_touch_pointer_emulation = true;
+    options.terminate_delay = config->xwayland.terminateDelay;
+    if (wlr_xwayland_server *xwaylandServer = wlr_xwayland_server_create(server->display->handle(), &options))
+        m_xwayland = wlr_xwayland_create_with_server(server->display->handle(),
+                                                     server->compositor->handle(), xwaylandServer);
+#else
+    /* wlroots 0.16 always keeps an idle server for 10 seconds. */
+    m_xwayland = wlr_xwayland_create(server->display->handle(), server->compositor->handle(), true);
+#endif
+    if (!m_xwayland) {
+        qWarning("failed to set up Xwayland, X11 clients won't be able to connect");
+        return;
+    }
+
+    m_sc.connect(&m_xwayland->events.ready, this, &QBoxXwayland::onReady);
+    m_sc.connect(&m_xwayland->events.new_surface, this, &QBoxXwayland::onNewSurface);
+    wlr_xwayland_set_seat(m_xwayland, server->seat->m_seat->handle());
+    /* Inherited by everything spawned from here on. */
+    setenv("DISPLAY", m_xwayland->display_name, true);
+#else
+    qInfo("wlroots was built without Xwayland, X11 clients are not supported");
+#endif
+}
+
+#if WLR_HAS_XWAYLAND
+void QBoxXwayland::onReady()
+{
+    /* Runs on every (lazy) start. X11 clients only see the root window
+     * cursor until they set their own. */
+    auto config = m_server->config->current();
+    const QByteArray theme = config->cursor.theme.toUtf8();
+    wlr_xcursor_manager *manager = wlr_xcursor_manager_create(theme.isEmpty() ? nullptr : theme.constData(),
+                                                              config->cursor.size);
+    if (manager && wlr_xcursor_manager_load(manager, 1)) {
+        if (wlr_xcursor *xcursor = wlr_xcursor_manager_get_xcursor(manager, "default", 1)) {
+            wlr_xcursor_image *image = xcursor->images[0];
+            wlr_xwayland_set_cursor(m_xwayland, image->buffer, image->width * 4, image->width,
+                                    image->height, image->hotspot_x, image->hotspot_y);
+        }
+    }
+    /* The image was copied. */
+    wlr_xcursor_manager_destroy(manager);
+}
+
+void QBoxXwayland::onNewSurface(wlr_xwayland_surface *xsurface)
+{
+    auto *surface = new Surface;
+    surface->xwayland = this;
+    surface->xsurface = xsurface;
+
+    surface->destroy.notify = &QBoxXwayland::handleDestroy;
+    wl_signal_add(&xsurface->events.destroy, &surface->destroy);
+    surface->map.notify = &QBoxXwayland::handleMap;
+    surface->unmap.notify = &QBoxXwayland::handleUnmap;
+#if WLR_VERSION_MINOR > 17
+    surface->associate.notify = &QBoxXwayland::handleAssociate;
+    wl_signal_add(&xsurface->events.associate, &surface->associate);
+    surface->dissociate.notify = &QBoxXwayland::handleDissociate;
+    wl_signal_add(&xsurface->events.dissociate, &surface->dissociate);
+    wl_list_init(&surface->map.link);
+    wl_list_init(&surface->unmap.link);
+#else
+    wl_list_init(&surface->associate.link);
+    wl_list_init(&surface->dissociate.link);
+    wl_signal_add(&xsurface->events.map, &surface->map);
+    wl_signal_add(&xsurface->events.unmap, &surface->unmap);
+#endif
+    surface->requestConfigure.notify = &QBoxXwayland::handleRequestConfigure;
+    wl_signal_add(&xsurface->events.request_configure, &surface->requestConfigure);
+    surface->requestActivate.notify = &QBoxXwayland::handleRequestActivate;
+    wl_signal_add(&xsurface->events.request_activate, &surface->requestActivate);
+    surface->requestMove.notify = &QBoxXwayland::handleRequestMove;
+    wl_signal_add(&xsurface->events.request_move, &surface->requestMove);
+    surface->requestResize.notify = &QBoxXwayland::handleRequestResize;
+    wl_signal_add(&xsurface->events.request_resize, &surface->requestResize);
+    surface->requestFullscreen.notify = &QBoxXwayland::handleRequestFullscreen;
+    wl_signal_add(&xsurface->events.request_fullscreen, &surface->requestFullscreen);
+    surface->setGeometry.notify = &QBoxXwayland::handleSetGeometry;
+    wl_signal_add(&xsurface->events.set_geometry, &surface->setGeometry);
+}
+
+void QBoxXwayland::mapSurface(Surface *surface)
+{
+    wlr_xwayland_surface *xsurface = surface->xsurface;
+    auto *xdgShell = m_server->xdgShell;
+
+    auto *view = new View();
+    view->server = m_server;
+    view->id = xdgShell->m_nextViewId++;
+    view->xwaylandSurface = xsurface;
+    view->geometry = QRect(xsurface->x, xsurface->y, xsurface->width, xsurface->height);
+    wlr_scene_tree *tree = wlr_scene_tree_create(&xdgShell->getScene()->handle()->tree);
+    wlr_scene_subsurface_tree_create(tree, xsurface->surface);
+    view->sceneTree = QWSceneTree::from(tree);
+    surface->view = view;
+    surface->managed = !xsurface->override_redirect;
+
+    if (!surface->managed) {
+        /* No data on the tree, viewAt() still finds the surface for
+         * pointer focus but it never becomes a focused view. */
+        view->sceneTree->setPosition(view->geometry.topLeft());
+        return;
+    }
+    tree->node.data = view;
+    xdgShell->mapView(view, true);
+    if (xsurface->fullscreen)
+        xdgShell->setFullscreen(view, true);
+}
+
+void QBoxXwayland::unmapSurface(Surface *surface)
+{
+    View *view = surface->view;
+    if (!view)
+        return;
+    surface->view = nullptr;
+    auto *xdgShell = m_server->xdgShell;
+    if (surface->managed)
+        xdgShell->unmapView(view);
+    /* A window mapping again gets a new view, as xdg toplevels do. */
+    wlr_scene_node_destroy(&view->sceneTree->handle()->node);
+    xdgShell->destroyView(view);
+}
+
+void QBoxXwayland::handleDestroy(wl_listener *listener, void *)
+{
+    Surface *surface = wl_container_of(listener, surface, destroy);
+    surface->xwayland->unmapSurface(surface);
+    wl_list_remove(&surface->destroy.link);
+    wl_list_remove(&surface->associate.link);
+    wl_list_remove(&surface->dissociate.link);
+    wl_list_remove(&surface->map.link);
+    wl_list_remove(&surface->unmap.link);
+    wl_list_remove(&surface->requestConfigure.link);
+    wl_list_remove(&surface->requestActivate.link);
+    wl_list_remove(&surface->requestMove.link);
+    wl_list_remove(&surface->requestResize.link);
+    wl_list_remove(&surface->requestFullscreen.link);
+    wl_list_remove(&surface->setGeometry.link);
+    delete surface;
+}
+
+void QBoxXwayland::handleAssociate(wl_listener *listener, void *)
+{
+#if WLR_VERSION_MINOR > 17
+    Surface *surface = wl_container_of(listener, surface, associate);
+    wl_signal_add(&surface->xsurface->surface->events.map, &surface->map);
+    wl_signal_add(&surface->xsurface->surface->events.unmap, &surface->unmap);
+#else
+    Q_UNUSED(listener);
+#endif
+}
+
+void QBoxXwayland::handleDissociate(wl_listener *listener, void *)
+{
+    Surface *surface = wl_container_of(listener, surface, dissociate);
+    surface->xwayland->unmapSurface(surface);
+    wl_list_remove(&surface->map.link);
+    wl_list_init(&surface->map.link);
+    wl_list_remove(&surface->unmap.link);
+    wl_list_init(&surface->unmap.link);
+}
+
+void QBoxXwayland::handleMap(wl_listener *listener, void *)
+{
+    Surface *surface = wl_container_of(listener, surface, map);
+    surface->xwayland->mapSurface(surface);
+}
+
+void QBoxXwayland::handleUnmap(wl_listener *listener, void *)
+{
+    Surface *surface = wl_container_of(listener, surface, unmap);
+    surface->xwayland->unmapSurface(surface);
+}
+
+void QBoxXwayland::handleRequestConfigure(wl_listener *listener, void *data)
+{
+    Surface *surface = wl_container_of(listener, surface, requestConfigure);
+    auto *event = static_cast<wlr_xwayland_surface_configure_event*>(data);
+    View *view = surface->view;
+    if (view && view->fullscreen) {
+        /* Keep covering the output. */
+        view->setSize(view->geometry.size());
+        return;
+    }
+    wlr_xwayland_surface_configure(event->surface, event->x, event->y, event->width, event->height);
+    if (view) {
+        view->geometry = QRect(event->x, event->y, event->width, event->height);
+        view->sceneTree->setPosition(view->geometry.topLeft());
+        Q_EMIT surface->xwayland->m_server->xdgShell->viewMoved(view);
+    }
+}
+
+void QBoxXwayland::handleRequestActivate(wl_listener *listener, void *)
+{
+    Surface *surface = wl_container_of(listener, surface, requestActivate);
+    if (surface->view && surface->managed)
+        surface->xwayland->m_server->xdgShell->focusView(surface->view, surface->view->surface());
+}
+
+void QBoxXwayland::handleRequestMove(wl_listener *listener, void *)
+{
+    Surface *surface = wl_container_of(listener, surface, requestMove);
+    auto *xdgShell = surface->xwayland->m_server->xdgShell;
+    if (surface->view && surface->managed && xdgShell->hasPointerFocus(surface->view))
+        xdgShell->beginInteractive(surface->view, QBoxCursor::CursorState::MovingWindow, 0);
+}
+
+void QBoxXwayland::handleRequestResize(wl_listener *listener, void *data)
+{
+    Surface *surface = wl_container_of(listener, surface, requestResize);
+    auto *event = static_cast<wlr_xwayland_resize_event*>(data);
+    auto *xdgShell = surface->xwayland->m_server->xdgShell;
+    if (surface->view && surface->managed && xdgShell->hasPointerFocus(surface->view))
+        xdgShell->beginInteractive(surface->view, QBoxCursor::CursorState::ResizingWindow, event->edges);
+}
+
+void QBoxXwayland::handleRequestFullscreen(wl_listener *listener, void *)
+{
+    /* Before mapping this is only recorded, mapSurface() applies it. */
+    Surface *surface = wl_container_of(listener, surface, requestFullscreen);
+    if (surface->view && surface->managed)
+        surface->xwayland->m_server->xdgShell->setFullscreen(surface->view, surface->xsurface->fullscreen);
+}
+
+void QBoxXwayland::handleSetGeometry(wl_listener *listener, void *)
+{
+    /* Override redirect windows move themselves. */
+    Surface *surface = wl_container_of(listener, surface, setGeometry);
+    if (!surface->view || surface->managed)
+        return;
+    wlr_xwayland_surface *xsurface = surface->xsurface;
+    surface->view->geometry = QRect(xsurface->x, xsurface->y, xsurface->width, xsurface->height);
+    surface->view->sceneTree->setPosition(surface->view->geometry.topLeft());
+    Q_EMIT surface->xwayland->m_server->xdgShell->viewMoved(surface->view);
+}
+#endif
@@ -0,0 +1,79 @@
+#ifndef QBOXXWAYLAND_H
+#define QBOXXWAYLAND_H
+
+#include "qboxoutput.h"
+
+#include <qwsignalconnector.h>
+#include <QObject>
+
+extern "C" {
+#include <wayland-server-core.h>
+}
+
+struct wlr_xwayland;
+struct wlr_xwayland_surface;
+
+using QW_NAMESPACE::QWSignalConnector;
+
+class QBoxServer;
+
+/* X11 clients through Xwayland.
+ *
+ * Only the X11 sockets exist up front, the Xwayland server is started by
+ * the first client connecting to them and stopped again [xwayland]
+ * terminate_delay seconds after the last one left. Managed X11 windows
+ * become views like xdg toplevels, override redirect ones (menus,
+ * tooltips) are only put in the scene. */
+class QBoxXwayland : public QObject
+{
+    Q_OBJECT
+    using View = QBoxOutPut::View;
+public:
+    explicit QBoxXwayland(QBoxServer *server);
+
+private:
+    struct Surface
+    {
+        wl_listener destroy;
+        /* wlroots 0.18 maps the wl_surface, which is only known once
+         * associated with the X11 window. */
+        wl_listener associate;
+        wl_listener dissociate;
+        wl_listener map;
+        wl_listener unmap;
+        wl_listener requestConfigure;
+        wl_listener requestActivate;
+        wl_listener requestMove;
+        wl_listener requestResize;
+        wl_listener requestFullscreen;
+        wl_listener setGeometry;
+        QBoxXwayland *xwayland;
+        wlr_xwayland_surface *xsurface;
+        /* While mapped. */
+        View *view = nullptr;
+        bool managed = false;
+    };
+
+    void onReady();
+    void onNewSurface(wlr_xwayland_surface *xsurface);
+    void mapSurface(Surface *surface);
+    void unmapSurface(Surface *surface);
+    static void handleDestroy(wl_listener *listener, void *data);
+    static void handleAssociate(wl_listener *listener, void *data);
+    static void handleDissociate(wl_listener *listener, void *data);
+    static void handleMap(wl_listener *listener, void *data);
+    static void handleUnmap(wl_listener *listener, void *data);
+    static void handleRequestConfigure(wl_listener *listener, void *data);
+    static void handleRequestActivate(wl_listener *listener, void *data);
+    static void handleRequestMove(wl_listener *listener, void *data);
+    static void handleRequestResize(wl_listener *listener, void *data);
+    static void handleRequestFullscreen(wl_listener *listener, void *data);
+    static void handleSetGeometry(wl_listener *listener, void *data);
+
+    wlr_xwayland *m_xwayland = nullptr;
+    QWSignalConnector m_sc;
+
+    QBoxServer *m_server;
+};
+
+#endif // QBOXXWAYLAND_H